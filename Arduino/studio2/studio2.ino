@@ -132,6 +132,18 @@ BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
 	return retVal;
 }
 
+// *****************************************************************************************************************
+//						Keys pressed on a keypad as a bit mask, bit n is key n, latched by the CPU
+// *****************************************************************************************************************
+
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad)
+{
+	WORD16 mask = 0;
+	for (byte key = 0;key < 16;key++)												// From the last scan, done at frame sync
+		if (isPressed[key]) mask |= (1U << key);
+	return mask;																	// I only have one keypad so shared for S2
+}
+
 // *****************************************************************************************************************
 //									Generated PROGMEM data for uploading into RAM
 // *****************************************************************************************************************
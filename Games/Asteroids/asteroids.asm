@@ -86,6 +86,11 @@ MissileLifeSpan = 24 										; number of missile moves before self-termination
 ; ***************************************************************************************************************************************
 
     	.include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+    	.st2title "Asteroids"
+    	.st2cat "PSR006"
+    	.st2author "PR"
+    	.st2dumper "PR"
     	.org    400h										; ROM code in S2 starts at $400.
 StartCode:
     	.db     >(StartGame),<(StartGame)					; This is required for the Studio 2, which runs from StartGame with P = 3
@@ -1602,5 +1607,3 @@ AsteroidGraphics:
 		.db 	64,160,192,0
 		.db 	96,128,96,0
 		.db 	192,160,64,0
-
-		.db 	0
\ No newline at end of file
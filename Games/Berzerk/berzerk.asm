@@ -76,6 +76,11 @@ PlayerMissileObject = ObjectStart+1*ObjectRecordSize
 ; ***************************************************************************************************************************************
 
     	.include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+    	.st2title "Berzerk"
+    	.st2cat "PSR008"
+    	.st2author "PR"
+    	.st2dumper "PR"
     	.org    400h										; ROM code in S2 starts at $400.
 StartCode:
     	.db     >(StartGame),<(StartGame)					; This is required for the Studio 2, which runs from StartGame with P = 3
@@ -59,6 +59,11 @@ MVLeft  = $20
 MVRight = $10
 
         .include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+        .st2title "Combat"
+        .st2cat "PSR003"
+        .st2author "PR"
+        .st2dumper "PR"
         .org    400h                    ; where RCA Studio II games start
         .db     >(Start),<(Start)  ; Internal Code call to Machine Code
         nop
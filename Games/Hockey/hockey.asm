@@ -56,6 +56,11 @@ BallTmr = $8CE
 BatTmr  = $8CF
 
         .include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+        .st2title "Hockey"
+        .st2cat "PSR002"
+        .st2author "PR"
+        .st2dumper "PR"
         .org    400h
         .db     >(StartGame),<(StartGame)
 
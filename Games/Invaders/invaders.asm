@@ -48,6 +48,11 @@ ISRight = 2
 ISDownRight = 3
    
         .include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+        .st2title "Space Invaders"
+        .st2cat "PSR001"
+        .st2author "PR"
+        .st2dumper "PR"
         .org    400h                    ; where RCA Studio II games start
         .db     >(Start),<(Start)  ; Internal Code call to Machine Code
 
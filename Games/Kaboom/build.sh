@@ -1,3 +1,3 @@
 rm *.tar.gz *.zip
-python2 makest2.py
+../../bin/asmx -r -ew -o kaboom.st2 kaboom.asm
 zip kaboom.zip * 
@@ -80,6 +80,11 @@ BombMovesPerFrame = 4 										; no of attempted bomb moves per frame.
 ; ***************************************************************************************************************************************
 
     	.include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+    	.st2title "Kaboom"
+    	.st2cat "PSR004"
+    	.st2author "PR"
+    	.st2dumper "PR"
     	.org    400h										; ROM code in S2 starts at $400.
 StartCode:
     	.db     >(StartGame),<(StartGame)					; This is required for the Studio 2, which runs from StartGame with P = 3
@@ -115,6 +115,11 @@ SpriteStorageEnd = SpriteStorage + (SpriteRecordSize*SpriteCount)
 ; ***************************************************************************************************************************************
 
     	.include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+    	.st2title "Pacman"
+    	.st2cat "PSR005"
+    	.st2author "PR"
+    	.st2dumper "PR"
     	.org    400h										; ROM code in S2 starts at $400.
 StartCode:
     	.db     >(StartGame),<(StartGame)					; This is required for the Studio 2, which runs from StartGame with P = 3
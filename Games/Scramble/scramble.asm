@@ -74,6 +74,11 @@ BulletObject = ObjectStart 									; first is the bullet object.
 ; ***************************************************************************************************************************************
 
     	.include "1802.inc"
+; header of the .st2 cartridge file made by asmx -r
+    	.st2title "Scramble"
+    	.st2cat "PSR007"
+    	.st2author "PR"
+    	.st2dumper "PR"
     	.org    400h										; ROM code in S2 starts at $400.
 StartCode:
     	.db     >(StartGame),<(StartGame)					; This is required for the Studio 2, which runs from StartGame with P = 3
@@ -1,5 +1,4 @@
 @echo off
-..\..\bin\asmx -s9 -l -ew -C 1802 %APP%.asm 
-python ..\s9tobinary.py %APP%.asm.s9
-python ..\makest2.py
+..\..\bin\asmx -r -l -ew -o %APP%.st2 %APP%.asm
+..\..\bin\asmx -b 0x400-0xFFF -ew -C 1802 %APP%.asm
 ..\..\bin\studio2 %APP%.asm.bin
@@ -0,0 +1,13 @@
+@echo off
+rem Build every game to ST2 and Binary, then the test program. All the games
+rem are assembled by one run of asmx, which works on them at the same time;
+rem -r with -b writes each game's .st2 cartridge and its binary for the
+rem emulator from the same assembly.
+echo Building all games to ST2 and Binary
+set GAMES=Asteroids\asteroids.asm Berzerk\berzerk.asm Combat\combat.asm Hockey\hockey.asm Invaders\invaders.asm Kaboom\kaboom.asm Pacman\pacman.asm Scramble\scramble.asm
+..\bin\asmx -r -b -l -ew %GAMES%
+rem -o can't name several outputs, so each cartridge comes out as <game>.asm.st2
+for %%G in (%GAMES%) do move /y %%G.st2 %%~dpnG.st2 >nul
+rem the speed test is not a cartridge, so it is a plain binary from address 0
+echo Building tests
+..\bin\asmx -C 1802 -e -l -b -- ..\Testing\speed.asm
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Build every game to ST2 and Binary, then the test program. All the games
+# are assembled by one run of asmx, which works on them at the same time;
+# -r with -b writes each game's .st2 cartridge and its binary for the
+# emulator from the same assembly.
+cd "$(dirname "$0")"
+ASMX=${ASMX:-../bin/asmx}
+echo Building all games to ST2 and Binary
+GAMES="Asteroids/asteroids.asm Berzerk/berzerk.asm Combat/combat.asm Hockey/hockey.asm Invaders/invaders.asm Kaboom/kaboom.asm Pacman/pacman.asm Scramble/scramble.asm"
+$ASMX -r -b -l -ew $GAMES || exit 1
+# -o can't name several outputs, so each cartridge comes out as <game>.asm.st2
+for g in $GAMES; do mv -f $g.st2 ${g%.asm}.st2; done
+# the speed test is not a cartridge, so it is a plain binary from address 0
+echo Building tests
+$ASMX -C 1802 -e -l -b -- ../Testing/speed.asm
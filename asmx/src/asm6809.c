@@ -333,7 +333,7 @@ const char pshRegs[] = "CC A B DP X Y U PC D S";
 const char idxRegs[] = "X Y U S";
 const char idxRegsW[] = "X Y U S W";
 
-u_char dpReg;
+THREAD u_char dpReg;
 
 
 // --------------------------------------------------------------
@@ -890,7 +890,7 @@ int M6809_DoCPULabelOp(int typ, int parm, char *labl)
                 {
                     dpReg = val;
 
-                    if (pass == 2)
+                    if (outPass)
                     {
                         p = listLine + 2;
                         p = ListByte(p,val);
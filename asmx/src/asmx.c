@@ -1,6 +1,18 @@
 // asmx.c - copyright 1998-2007 Bruce Tomlin
 
 #include "asmx.h"
+#include "asmxlib.h"
+
+// several source files are assembled on worker threads, and the
+// library's one-time setup may be started from several threads
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
 
 #define VERSION_NAME "asmx multi-assembler"
 
@@ -20,6 +32,17 @@ const int symTabCols = 3;       // number of columns for symbol table dump
 //#define MAX_BYTSTR  1024        // size of bytStr[] (moved to asmx.h)
 #define MAX_COND    256         // maximum nesting level of IF blocks
 #define MAX_MACRO   10          // maximum nesting level of MACRO invocations
+#define SYMHASH_MIN 1024        // initial size of symbol hash table (power of 2)
+#define MACROHASH_MIN 64        // initial size of macro hash table (power of 2)
+#define SYM_ARENA   65536       // size of each block of symbol storage
+#define MAX_FWDREF  8           // maximum forward references in a line for one-pass fixups
+#define MAX_BINWIN  8           // maximum address windows in a binary object file
+#define BIN_IMGMIN  65536       // initial size of binary object file image
+#define ST2_BASE    0x400       // first address of a Studio II cartridge
+#define ST2_END     0xFFF       // last address of a Studio II cartridge
+#define ST2_RAM     0x800       // first address of the console's RAM, not in a cartridge
+#define ST2_RAMEND  0x9FF       // last address of the console's RAM
+#define MAX_JOBS    64          // maximum threads for a batch of source files
 
 #if 0
 // these should already be defined in sys/types.h (included from stdio.h)
@@ -32,10 +55,12 @@ typedef   unsigned long   u_long;
 // --------------------------------------------------------------
 
 const char      *progname;      // pointer to argv[0]
+THREAD asmx_context *asmxCtx;   // library caller's context, NULL for the command line
 
-struct SymRec
+THREAD struct SymRec
 {
-    struct SymRec   *next;      // pointer to next symtab entry
+    struct SymRec   *next;      // pointer to next symtab entry (for the symbol table dump)
+    u_int           hash;       // hash of name
     u_long          value;      // symbol value
     bool            defined;    // TRUE if defined
     bool            multiDef;   // TRUE if multiply defined
@@ -46,9 +71,28 @@ struct SymRec
 } *symTab = NULL;           // pointer to first entry in symbol table
 typedef struct SymRec *SymPtr;
 
+THREAD SymPtr   *symHash = NULL;    // open addressing hash table of symbols, by name
+THREAD u_int    symHashSize;        // size of symHash (power of 2)
+THREAD u_int    symCount;           // number of symbols in symHash
+THREAD char     *symArena;          // free space for new symbols
+THREAD size_t   symArenaLeft;       // bytes left at symArena
+THREAD char     *symBlocks;         // list of symbol storage blocks, for FreeState
+
+struct MacroTok
+{
+    u_short             typ;        // token type, mt_Text etc.
+    u_short             ofs;        // offset of text in macro line
+    u_short             len;        // length of text, or parameter index for mt_Parm
+};
+typedef struct MacroTok *MacroTokPtr;
+enum { mt_Text, mt_Parm, mt_NParms, mt_UniqueID, mt_Trim };
+
 struct MacroLine
 {
     struct MacroLine    *next;      // pointer to next macro line
+    MacroTokPtr         tok;        // macro line split into text and parameters
+    int                 ntok;       // number of tokens
+    int                 opts;       // CPU options when tokens were made
     char                text[1];    // macro line, storage = 1 + length
 };
 typedef struct MacroLine *MacroLinePtr;
@@ -60,7 +104,7 @@ struct MacroParm
 };
 typedef struct MacroParm *MacroParmPtr;
 
-struct MacroRec
+THREAD struct MacroRec
 {
     struct MacroRec     *next;      // pointer to next macro
     bool                def;        // TRUE after macro is defined in pass 2
@@ -72,7 +116,11 @@ struct MacroRec
 } *macroTab = NULL;             // pointer to first entry in macro table
 typedef struct MacroRec *MacroPtr;
 
-struct SegRec
+THREAD MacroPtr *macroHash = NULL;  // open addressing hash table of macros, by name
+THREAD u_int    macroHashSize;      // size of macroHash (power of 2)
+THREAD u_int    macroCount;         // number of macros in macroHash
+
+THREAD struct SegRec
 {
     struct SegRec       *next;      // pointer to next segment
 //  bool                gen;        // FALSE to supress code output (not currently implemented)
@@ -82,6 +130,63 @@ struct SegRec
 } *segTab = NULL;               // pointer to first entry in macro table
 typedef struct SegRec *SegPtr;
 
+THREAD struct SrcFileRec
+{
+    struct SrcFileRec   *next;      // pointer to next source file
+    char                *text;      // file contents, split into lines in place
+    char                **lines;    // pointers to each line in text
+    int                 nlines;     // number of lines
+    char                name[1];    // file name, storage = 1 + length
+} *srcFileTab = NULL;           // pointer to first entry in library caller's source file cache
+typedef struct SrcFileRec *SrcFilePtr;
+SrcFilePtr      srcFileCache;       // command line source file cache, shared by batch threads
+
+#if defined(ASMX_LIBRARY)
+#define LockBatch()
+#define UnlockBatch()
+#elif defined(_WIN32)
+CRITICAL_SECTION batchLock;         // protects srcFileCache and the batch file list, set up by main
+#define LockBatch()     EnterCriticalSection(&batchLock)
+#define UnlockBatch()   LeaveCriticalSection(&batchLock)
+#else
+pthread_mutex_t batchLock = PTHREAD_MUTEX_INITIALIZER; // protects srcFileCache and the batch file list
+#define LockBatch()     pthread_mutex_lock(&batchLock)
+#define UnlockBatch()   pthread_mutex_unlock(&batchLock)
+#endif
+
+struct FixupText
+{
+    long                pos;        // start of the line's text
+    long                end;        // end of the line's text
+    long                newPos;     // start of the reassembled line's text
+    long                newEnd;     // end of the reassembled line's text
+};
+
+THREAD struct FixupRec
+{
+    struct FixupRec     *next;      // pointer to next fixup
+    u_long              loc;        // locPtr at start of line
+    u_long              cod;        // codPtr at start of line
+    u_long              locEnd;     // locPtr at end of line
+    long                img;        // offset of the line's code in the image
+    long                imgLen;     // length of the line's code
+    struct FixupText    list;       // listing text
+    struct FixupText    err;        // messages to the screen
+    struct CpuRec       *cpu;       // CPU for the line
+    char                *fname;     // include file name, NULL if main source file
+    int                 linenum;    // line number in source file
+    bool                listFlag;   // listing flags for the line
+    bool                listMacFlag;
+    bool                expandHexFlag;
+    bool                macLineFlag;
+    int                 nfwd;       // number of symbols not yet defined
+    SymPtr              fwd[MAX_FWDREF]; // symbols not yet defined
+    char                *lastLabl;  // lastLabl and subrLabl, stored after text
+    char                *subrLabl;
+    char                text[1];    // text of line, storage = 1 + length
+} *fixupTab = NULL;             // pointer to first fixup
+typedef struct FixupRec *FixupPtr;
+
 #if 0 // moved to asmx.h
 typedef char OpcdStr[maxOpcdLen+1];
 struct OpcdRec
@@ -93,17 +198,17 @@ struct OpcdRec
 typedef struct OpcdRec *OpcdPtr;
 #endif
 
-int             macroCondLevel;     // current IF nesting level inside a macro definition
-int             macUniqueID;        // unique ID, incremented per macro invocation
-int             macLevel;           // current macro nesting level
-int             macCurrentID[MAX_MACRO]; // current unique ID
-MacroPtr        macPtr[MAX_MACRO];  // current macro in use
-MacroLinePtr    macLine[MAX_MACRO]; // current macro text pointer
-int             numMacParms[MAX_MACRO];  // number of macro parameters
-Str255          macParmsLine[MAX_MACRO]; // text of current macro parameters
-char            *macParms[MAXMACPARMS * MAX_MACRO]; // pointers to current macro parameters
+THREAD int      macroCondLevel;     // current IF nesting level inside a macro definition
+THREAD int      macUniqueID;        // unique ID, incremented per macro invocation
+THREAD int      macLevel;           // current macro nesting level
+THREAD int      macCurrentID[MAX_MACRO]; // current unique ID
+THREAD MacroPtr macPtr[MAX_MACRO];  // current macro in use
+THREAD MacroLinePtr macLine[MAX_MACRO]; // current macro text pointer
+THREAD int      numMacParms[MAX_MACRO];  // number of macro parameters
+THREAD Str255   macParmsLine[MAX_MACRO]; // text of current macro parameters
+THREAD char     *macParms[MAXMACPARMS * MAX_MACRO]; // pointers to current macro parameters
 #ifdef ENABLE_REP
-int             macRepeat[MAX_MACRO]; // repeat count for REP pseudo-op
+THREAD int      macRepeat[MAX_MACRO]; // repeat count for REP pseudo-op
 #endif
 
 struct AsmRec
@@ -133,88 +238,110 @@ typedef struct CpuRec *CpuPtr;
 
 // --------------------------------------------------------------
 
-SegPtr          curSeg;             // current segment
-SegPtr          nullSeg;            // default null segment
-
-u_long          locPtr;             // Current program address
-u_long          codPtr;             // Current program "real" address
-int             pass;               // Current assembler pass
-bool            warnFlag;           // TRUE if warning occurred this line
-bool            errFlag;            // TRUE if error occurred this line
-int             errCount;           // Total number of errors
-
-Str255          line;               // Current line from input file
-char           *linePtr;            // pointer into current line
-Str255          listLine;           // Current listing line
-bool            listLineFF;         // TRUE if an FF was in the current listing line
-bool            listFlag;           // FALSE to suppress listing source
-bool            listThisLine;       // TRUE to force listing this line
-bool            sourceEnd;          // TRUE when END pseudo encountered
-Str255          lastLabl;           // last label for '@' temp labels
-Str255          subrLabl;           // current SUBROUTINE label for '.' temp labels
-bool            listMacFlag;        // FALSE to suppress showing macro expansions
-bool            macLineFlag;        // TRUE if line came from a macro
-int             linenum;            // line number in main source file
-bool            expandHexFlag;      // TRUE to expand long hex data to multiple listing lines
-bool            symtabFlag;         // TRUE to show symbol table in listing
-bool            tempSymFlag;        // TRUE to show temp symbols in symbol table listing
-
-int             condLevel;          // current IF nesting level
-char            condState[MAX_COND]; // state of current nesting level
+THREAD SegPtr   curSeg;             // current segment
+THREAD SegPtr   nullSeg;            // default null segment
+
+THREAD u_long   locPtr;             // Current program address
+THREAD u_long   codPtr;             // Current program "real" address
+THREAD int      pass;               // Current assembler pass
+THREAD bool     outPass;            // TRUE if this pass writes the listing and object code
+THREAD bool     onePass;            // TRUE while trying to assemble in one pass
+THREAD FixupPtr curFixup;           // line being reassembled at the end of one pass
+THREAD bool     fixupFail;          // TRUE if this line means one pass can't be used
+THREAD int      lineTyp;            // opcode type of the current line, for fixups
+THREAD bool     warnFlag;           // TRUE if warning occurred this line
+THREAD bool     errFlag;            // TRUE if error occurred this line
+THREAD int      errCount;           // Total number of errors
+
+THREAD Str255   line;               // Current line from input file
+THREAD char    *linePtr;            // pointer into current line
+THREAD Str255   listLine;           // Current listing line
+THREAD bool     listLineFF;         // TRUE if an FF was in the current listing line
+THREAD bool     listFlag;           // FALSE to suppress listing source
+THREAD bool     listThisLine;       // TRUE to force listing this line
+THREAD bool     sourceEnd;          // TRUE when END pseudo encountered
+THREAD Str255   lastLabl;           // last label for '@' temp labels
+THREAD Str255   subrLabl;           // current SUBROUTINE label for '.' temp labels
+THREAD bool     listMacFlag;        // FALSE to suppress showing macro expansions
+THREAD bool     macLineFlag;        // TRUE if line came from a macro
+THREAD int      linenum;            // line number in main source file
+THREAD bool     expandHexFlag;      // TRUE to expand long hex data to multiple listing lines
+THREAD bool     symtabFlag;         // TRUE to show symbol table in listing
+THREAD bool     tempSymFlag;        // TRUE to show temp symbols in symbol table listing
+
+THREAD int      condLevel;          // current IF nesting level
+THREAD char     condState[MAX_COND]; // state of current nesting level
 enum {
     condELSE = 1, // ELSE has already been countered at this level
     condTRUE = 2, // condition is currently true
     condFAIL = 4  // condition has failed (to handle ELSE after ELSIF)
 };
 
-int             instrLen;           // Current instruction length (negative to display as long DB)
-u_char          bytStr[MAX_BYTSTR]; // Current instruction / buffer for long DB statements
-int             hexSpaces;          // flags for spaces in hex output for instructions
-bool            showAddr;           // TRUE to show LocPtr on listing
-u_long          xferAddr;           // Transfer address from END pseudo
-bool            xferFound;          // TRUE if xfer addr defined w/ END
+THREAD int      instrLen;           // Current instruction length (negative to display as long DB)
+THREAD u_char   bytStr[MAX_BYTSTR]; // Current instruction / buffer for long DB statements
+THREAD int      hexSpaces;          // flags for spaces in hex output for instructions
+THREAD bool     showAddr;           // TRUE to show LocPtr on listing
+THREAD u_long   xferAddr;           // Transfer address from END pseudo
+THREAD bool     xferFound;          // TRUE if xfer addr defined w/ END
+THREAD char     st2Author[3];       // ST2 cartridge author ID
+THREAD char     st2Dumper[3];       // ST2 cartridge dumper ID
+THREAD char     st2Cat[16];         // ST2 cartridge RCA catalogue code
+THREAD char     st2Title[32];       // ST2 cartridge title
 
 //  Command line parameters
-Str255          cl_SrcName;         // Source file name
-Str255          cl_ListName;        // Listing file name
-Str255          cl_ObjName;         // Object file name
+THREAD Str255   cl_SrcName;         // Source file name
+THREAD Str255   cl_ListName;        // Listing file name
+THREAD Str255   cl_ObjName;         // Object file name
+THREAD Str255   cl_BinName;         // binary file name for -r with -b
 bool            cl_Err;             // TRUE for errors to screen
 bool            cl_Warn;            // TRUE for warnings to screen
 bool            cl_List;            // TRUE to generate listing file
 bool            cl_Obj;             // TRUE to generate object file
 bool            cl_ObjType;         // type of object file to generate:
-enum { OBJ_HEX, OBJ_S9, OBJ_BIN, OBJ_TRSDOS };  // values for cl_Obj
-u_long          cl_Binbase;         // base address for OBJ_BIN
-u_long          cl_Binend;          // end address for OBJ_BIN
+enum { OBJ_HEX, OBJ_S9, OBJ_BIN, OBJ_TRSDOS, OBJ_ST2 };  // values for cl_Obj
+u_long          cl_Binbase[MAX_BINWIN]; // base addresses for OBJ_BIN
+u_long          cl_Binend[MAX_BINWIN];  // end addresses for OBJ_BIN
+int             cl_BinWins;         // number of OBJ_BIN address windows
+bool            cl_ST2Bin;          // TRUE to also write the OBJ_ST2 image as a binary file
 int             cl_S9type;          // type of S9 file: 9, 19, 28, or 37
 bool            cl_Stdout;          // TRUE to send object file to stdout
 bool            cl_ListP1;          // TRUE to show listing in first assembler pass
-
-FILE            *source;            // source input file
-FILE            *object;            // object output file
-FILE            *listing;           // listing output file
-FILE            *incbin;            // binary include file
-FILE            *(include[MAX_INCLUDE]);    // include files
-Str255          incname[MAX_INCLUDE];       // include file names
-int             incline[MAX_INCLUDE];       // include line number
-int             nInclude;           // current include file index
-
-bool            evalKnown;          // TRUE if all operands in Eval were "known"
+bool            cl_OnePass;         // TRUE to try to assemble in one pass
+char * const    *cl_SrcFiles;       // source file names, more than one for a batch
+int             cl_NSrcFiles;       // number of source files
+char            **cl_Defs;          // -d options, repeated for each source file in a batch
+int             cl_NDefs;           // number of -d options
+Str255          cl_DefCPU;          // default CPU type for each source file in a batch
+int             cl_Jobs;            // number of threads for a batch, 0 for one per CPU
+
+THREAD SrcFilePtr source;           // source input file
+THREAD int      sourcePos;          // next line to read from source
+THREAD FILE     *object;            // object output file
+THREAD FILE     *listing;           // listing output file
+THREAD FILE     *incbin;            // binary include file
+THREAD SrcFilePtr include[MAX_INCLUDE];     // include files
+THREAD int      incPos[MAX_INCLUDE];        // next line to read from include file
+THREAD Str255   incname[MAX_INCLUDE];       // include file names
+THREAD int      incline[MAX_INCLUDE];       // include line number
+THREAD int      nInclude;           // current include file index
+
+THREAD bool     evalKnown;          // TRUE if all operands in Eval were "known"
 
 AsmPtr          asmTab;             // list of all assemblers
 CpuPtr          cpuTab;             // list of all CPU types
-AsmPtr          curAsm;             // current assembler
-int             curCPU;             // current CPU index for current assembler
-
-int             endian;             // CPU endian: UNKNOWN_END, LITTLE_END, BIG_END
-int             addrWid;            // CPU address width: ADDR_16, ADDR_32
-int             listWid;            // listing hex area width: LIST_16, LIST_24
-int             opts;               // current CPU's option flags
-int             wordSize;           // current CPU's addressing size in bits
-int             wordDiv;            // scaling factor for current word size
-int             addrMax;            // maximum addrWid used
-OpcdPtr         opcdTab;            // current CPU's opcode table
-Str255          defCPU;             // default CPU name
+THREAD AsmPtr   curAsm;             // current assembler
+THREAD int      curCPU;             // current CPU index for current assembler
+THREAD CpuPtr   curCpuPtr;          // current CPU
+
+THREAD int      endian;             // CPU endian: UNKNOWN_END, LITTLE_END, BIG_END
+THREAD int      addrWid;            // CPU address width: ADDR_16, ADDR_32
+THREAD int      listWid;            // listing hex area width: LIST_16, LIST_24
+THREAD int      opts;               // current CPU's option flags
+THREAD int      wordSize;           // current CPU's addressing size in bits
+THREAD int      wordDiv;            // scaling factor for current word size
+THREAD int      addrMax;            // maximum addrWid used
+THREAD OpcdPtr  opcdTab;            // current CPU's opcode table
+THREAD Str255   defCPU;             // default CPU name
 
 // --------------------------------------------------------------
 
@@ -246,6 +373,7 @@ enum
 #endif
     o_MacName,  // Macro name
     o_Processor,// CPU selection pseudo-op
+    o_ST2,      // ST2 cartridge header pseudo-ops
 
 //    o_LabelOp = 0x1000,   // flag to handle opcode in DoLabelOp
 
@@ -323,6 +451,10 @@ struct OpcdRec opcdTab2[] =
     {"INCBIN",    o_Incbin,   0},
     {"PROCESSOR", o_Processor,0},
     {"CPU",       o_Processor,0},
+    {"ST2AUTHOR", o_ST2,      0},
+    {"ST2DUMPER", o_ST2,      1},
+    {"ST2CAT",    o_ST2,      2},
+    {"ST2TITLE",  o_ST2,      3},
 
     {"=",         o_EQU,      0},
     {"EQU",       o_EQU,      0},
@@ -362,6 +494,14 @@ struct OpcdRec opcdTab2[] =
 void DoLine(void);          // forward declaration
 #endif
 
+void FixupRef(SymPtr p);    // forward declarations for one-pass mode
+void FixupRefAgain(SymPtr p, bool *known);
+void ImageOut(int byte);
+void ImageBreak(void);
+void TextOut(FILE *f, char *s);
+void LibCodeOut(int byte);  // forward declarations for the library interface
+const char *LibInclude(char *fname, long *len);
+
 // --------------------------------------------------------------
 
 // multi-assembler call vectors
@@ -417,6 +557,8 @@ void *AddAsm(char *name,        // assembler name
     return p;
 }
 
+void IndexOpcodeTab(OpcdPtr tab);   // forward declaration
+
 void AddCPU(void *as,           // assembler for this CPU
             char *name,         // uppercase name of this CPU
             int index,          // index number for this CPU
@@ -443,6 +585,8 @@ void AddCPU(void *as,           // assembler for this CPU
     p -> opcdTab  = opcdTab;
 
     cpuTab = p;
+
+    IndexOpcodeTab(opcdTab);
 }
 
 
@@ -479,6 +623,7 @@ bool SetCPU(char *cpuName)
     {
         curCPU   = p -> index;
         curAsm   = p -> as;
+        curCpuPtr = p;
         endian   = p -> endian;
         addrWid  = p -> addrWid;
         listWid  = p -> listWid;
@@ -506,6 +651,8 @@ void AsmInit(void)
 
 #define ASSEMBLER(name) extern void Asm ## name ## Init(void); Asm ## name ## Init();
 
+    IndexOpcodeTab(opcdTab2);
+
     p = AddAsm("None", NULL, NULL, NULL);
     AddCPU(p, "NONE",  0, UNKNOWN_END, ADDR_32, LIST_24, 8, 0, NULL);
 
@@ -565,6 +712,7 @@ void Error(char *message)
 {
     char *name;
     int line;
+    char s[sizeof(Str255) * 2 + 32];
 
     errFlag = TRUE;
     errCount++;
@@ -577,11 +725,12 @@ void Error(char *message)
         line = incline[nInclude];
     }
 
-    if (pass == 2)
+    if (outPass)
     {
         listThisLine = TRUE;
-        if (cl_List)    fprintf(listing, "%s:%d: *** Error:  %s ***\n",name,line,message);
-        if (cl_Err)     fprintf(stderr,  "%s:%d: *** Error:  %s ***\n",name,line,message);
+        sprintf(s, "%s:%d: *** Error:  %s ***\n",name,line,message);
+        if (cl_List)    TextOut(listing, s);
+        if (cl_Err || asmxCtx)  TextOut(stderr,  s);
     }
 }
 
@@ -594,6 +743,7 @@ void Warning(char *message)
 {
     char *name;
     int line;
+    char s[sizeof(Str255) * 2 + 32];
 
     warnFlag = TRUE;
 
@@ -605,11 +755,12 @@ void Warning(char *message)
         line = incline[nInclude];
     }
 
-    if (pass == 2 && cl_Warn)
+    if (outPass && (cl_Warn || asmxCtx))
     {
         listThisLine = TRUE;
-        if (cl_List)    fprintf(listing, "%s:%d: *** Warning:  %s ***\n",name,line,message);
-        if (cl_Warn)    fprintf(stderr,  "%s:%d: *** Warning:  %s ***\n",name,line,message);
+        sprintf(s, "%s:%d: *** Warning:  %s ***\n",name,line,message);
+        if (cl_List)    TextOut(listing, s);
+        TextOut(stderr,  s);
     }
 }
 
@@ -939,10 +1090,10 @@ char * ListLoc(u_long addr)
 // --------------------------------------------------------------
 // ZSCII conversion routines
 
-    u_char  zStr[MAX_BYTSTR];   // output data buffer
-    int     zLen;               // length of output data
-    int     zOfs,zPos;          // current output offset (in bytes) and bit position
-    int     zShift;             // current shift lock status (0, 1, 2)
+    THREAD u_char  zStr[MAX_BYTSTR];    // output data buffer
+    THREAD int     zLen;                // length of output data
+    THREAD int     zOfs,zPos;           // current output offset (in bytes) and bit position
+    THREAD int     zShift;              // current shift lock status (0, 1, 2)
     char    zSpecial[] = "0123456789.,!?_#'\"/\\<-:()"; // special chars table
 
 void InitZSCII(void)
@@ -1447,23 +1598,59 @@ u_int GetBackslashChar(void)
 }
 
 
+// --------------------------------------------------------------
+// hashing
+
+
+/*
+ *  HashName
+ *
+ *  FNV-1a hash of a symbol, macro or opcode name
+ */
+
+u_int HashName(char *name)
+{
+    u_int h = 2166136261U;
+
+    while (*name)
+        h = (h ^ (u_char) *name++) * 16777619U;
+
+    return h;
+}
+
+
 // --------------------------------------------------------------
 // macro handling
 
 
-MacroPtr FindMacro(char *name)
+/*
+ *  FindMacroSlot
+ *
+ *  returns the macroHash slot holding name, or the empty slot where it would go
+ */
+
+MacroPtr *FindMacroSlot(char *name)
 {
-    MacroPtr p = macroTab;
-    bool found = FALSE;
+    u_int       i = HashName(name) & (macroHashSize - 1);
+    MacroPtr    p;
 
-    while (p && !found)
+    while ((p = macroHash[i]) != NULL)
     {
-        found = (strcmp(p -> name, name) == 0);
-        if (!found)
-            p = p -> next;
+        if (strcmp(p -> name, name) == 0)
+            break;
+        i = (i + 1) & (macroHashSize - 1);  // linear probing
     }
 
-    return p;
+    return &macroHash[i];
+}
+
+
+MacroPtr FindMacro(char *name)
+{
+    if (macroHash == NULL)
+        return NULL;
+
+    return *FindMacroSlot(name);
 }
 
 
@@ -1491,10 +1678,32 @@ MacroPtr NewMacro(char *name)
 MacroPtr AddMacro(char *name)
 {
     MacroPtr    p;
+    MacroPtr    *old,*table;
+    u_int       oldSize,size,i;
+
+    if (macroCount >= macroHashSize / 2)
+    {   // keep macroHash at most half full
+        size  = (macroHashSize == 0) ? MACROHASH_MIN : macroHashSize * 2;
+        table = calloc(size, sizeof *table);
+        if (table == NULL)
+            return NULL;    // the old table is still good
+        old     = macroHash;
+        oldSize = macroHashSize;
+        macroHash     = table;
+        macroHashSize = size;
+        for (i = 0; i < oldSize; i++)
+            if (old[i])
+                *FindMacroSlot(old[i] -> name) = old[i];
+        free(old);
+    }
 
     p = NewMacro(name);
     if (p)
+    {
         macroTab = p;
+        *FindMacroSlot(name) = p;
+        macroCount++;
+    }
 
     return p;
 }
@@ -1521,6 +1730,145 @@ void AddMacroParm(MacroPtr macro, char *name)
 }
 
 
+/*
+ *  TokMacroLine
+ *
+ *  Splits a macro line into slices of plain text and the places where
+ *  parameters get substituted, so that expanding the macro only has to
+ *  paste the pieces together. This scans the line the same way the old
+ *  in-place substitution did: a parameter value is never rescanned, and
+ *  "##" trims the spaces before it from whatever has been pasted so far.
+ *  The scan depends on the CPU options for '$' and '@' in symbols, so
+ *  DoMacParms makes the tokens again if those have changed.
+ */
+
+void TokMacroLine(MacroPtr macro, MacroLinePtr m)
+{
+    int             i;
+    Str255          word;
+    MacroParmPtr    parm;
+    MacroTokPtr     t;
+    char            *oldLine;
+    char            *lit;   // pointer to start of text not yet in a token
+    char            *p;     // pointer to start of word
+    char            c;
+    int             token;
+    int             typ;
+    int             n;
+
+    free(m -> tok);
+    m -> ntok = 0;
+    m -> opts = opts;
+
+    // each token but the last uses up at least one char, and can add one text token
+    m -> tok = malloc((strlen(m -> text) * 2 + 1) * sizeof *t);
+    if (m -> tok == NULL)
+        return;
+    t = m -> tok;
+
+    oldLine = linePtr;
+    linePtr = m -> text;
+    lit = linePtr;
+
+    // skip initial whitespace
+    c = *linePtr;
+    while (c == 12 || c == '\t' || c == ' ')
+        c = *++linePtr;
+
+    // while not end of line
+    p = linePtr;
+    token = GetWord(word);
+    while (token)
+    {
+        typ = mt_Text;
+        n = 0;
+
+        // if alphanumeric, search for macro parameter of the same name
+        if (token == -1)
+        {
+            i = 0;
+            parm = macro -> parms;
+            while (parm && strcmp(parm -> name, word))
+            {
+                parm = parm -> next;
+                i++;
+            }
+
+            if (parm)
+            {
+                typ = mt_Parm;
+                n = i;
+            }
+        }
+        // handle '##' concatenation operator
+        else if (token == '#' && *linePtr == '#')
+        {
+            typ = mt_Trim;
+            p = linePtr - 1;
+            linePtr++;              // skip second '#'
+            // skip whitespace to the right
+            while (*linePtr == ' ') linePtr++;
+        }
+        // handle '\0' number of parameters operator
+        else if (token == '\\' && *linePtr == '0')
+        {
+            typ = mt_NParms;
+            p = linePtr++ - 1;
+        }
+        // handle '\n' parameter operator
+        else if (token == '\\' && '1' <= *linePtr && *linePtr <= '9')
+        {
+            typ = mt_Parm;
+            n = *linePtr - '1';
+            p = linePtr++ - 1;
+        }
+        // handle '\?' unique ID operator
+        else if (token == '\\' && *linePtr == '?')
+        {
+            typ = mt_UniqueID;
+            p = linePtr++ - 1;
+        }
+
+        // text up to p, then the token which ends at linePtr
+        if (typ != mt_Text)
+        {
+            if (p > lit)
+            {
+                t -> typ = mt_Text;
+                t -> ofs = lit - m -> text;
+                t -> len = p - lit;
+                t++;
+            }
+            t -> typ = typ;
+            t -> ofs = 0;
+            t -> len = n;
+            t++;
+            lit = linePtr;
+        }
+
+        // skip initial whitespace
+        c = *linePtr;
+        while (c == 12 || c == '\t' || c == ' ')
+            c = *++linePtr;
+
+        p = linePtr;
+        token = GetWord(word);
+    }
+
+    // the rest of the line (GetWord leaves linePtr at the end)
+    if (linePtr > lit)
+    {
+        t -> typ = mt_Text;
+        t -> ofs = lit - m -> text;
+        t -> len = linePtr - lit;
+        t++;
+    }
+
+    m -> ntok = t - m -> tok;
+    linePtr = oldLine;
+}
+
+
 void AddMacroLine(MacroPtr macro, char *line)
 {
     MacroLinePtr    m;
@@ -1530,7 +1878,9 @@ void AddMacroLine(MacroPtr macro, char *line)
     if (m)
     {
         m -> next = NULL;
+        m -> tok  = NULL;
         strcpy(m -> text, line);
+        TokMacroLine(macro, m);
 
         p = macro -> text;
         if (p)
@@ -1639,134 +1989,79 @@ void GetMacParms(MacroPtr macro)
 }
 
 
-void DoMacParms()
+/*
+ *  DoMacParms
+ *
+ *  Expands a macro line into s, substituting the parameters of the
+ *  current macro invocation.
+ */
+
+void DoMacParms(MacroLinePtr m, char *s, int max)
 {
+    MacroTokPtr     t;
+    char            *p;
+    char            *end;
+    char            *parm;
+    Str255          word;
+    int             len;
     int             i;
-    Str255          word,word2;
-    MacroParmPtr    parm;
-    char            *p;     // pointer to start of word
-    char            c;
-    int             token;
 
-    // start at beginning of line
-    linePtr = line;
+    if (m -> tok == NULL || m -> opts != opts)
+        TokMacroLine(macPtr[macLevel], m);
 
-    // skip initial whitespace
-    c = *linePtr;
-    while (c == 12 || c == '\t' || c == ' ')
-        c = *++linePtr;
+    if (m -> tok == NULL)
+    {   // no memory for the tokens, rather than an empty line
+        Error("Out of memory for macro");
+        *s = 0;
+        linePtr = s;
+        return;
+    }
 
-    // while not end of line
-    p = linePtr;
-    token = GetWord(word);
-    while (token)
+    p = s;
+    end = s + max - 1;
+    for (i = 0, t = m -> tok; i < m -> ntok; i++, t++)
     {
-        // if alphanumeric, search for macro parameter of the same name
-        if (token == -1)
+        switch(t -> typ)
         {
-            i = 0;
-            parm = macPtr[macLevel] -> parms;
-            while (parm && strcmp(parm -> name, word))
-            {
-                parm = parm -> next;
-                i++;
-            }
+            case mt_Text:
+                parm = m -> text + t -> ofs;
+                len = t -> len;
+                break;
 
-            // if macro parameter found, replace parameter name with parameter value
-            if (parm)
-            {
-                // copy from linePtr to temp string
-                strcpy(word, linePtr);
-                // copy from corresponding parameter to p
-                strcpy(p, macParms[i + macLevel * MAXMACPARMS]);
-                // point p to end of appended text
-                p = p + strlen(macParms[i + macLevel * MAXMACPARMS]);
-                // copy from temp to p
-                strcpy(p, word);
-                // update linePtr
-                linePtr = p;
-            }
-        }
-        // handle '##' concatenation operator
-        else if (token == '#' && *linePtr == '#')
-        {
-            p = linePtr + 1;    // skip second '#'
-            linePtr--;          // skip first '#'
-            // skip whitespace to the left
-            while (linePtr > line && linePtr[-1] == ' ')
-                linePtr--;
-            // skip whitespace to the right
-            while (*p == ' ') p++;
-            // copy right side of chopped zone
-            strcpy(word, p);
-            // paste it at new linePtr
-            strcpy(linePtr, word);
-            // and linePtr now even points to where it should
-        }
-        // handle '\0' number of parameters operator
-        else if (token == '\\' && *linePtr == '0')
-        {
-            p = linePtr + 1;    // skip '0'
-            linePtr--;          // skip '\'
-            // make string of number of parameters
-            sprintf(word2, "%d", numMacParms[macLevel]);
-            // copy right side of chopped zone
-            strcpy(word, p);
-            // paste number
-            strcpy(linePtr, word2);
-            linePtr = linePtr + strlen(word2);
-            // paste right side at new linePtr
-            strcpy(linePtr, word);
-        }
-        // handle '\n' parameter operator
-        else if (token == '\\' && '1' <= *linePtr && *linePtr <= '9')
-        {
-            i = *linePtr - '1';
-            p = linePtr + 1;    // skip 'n'
-            linePtr--;          // skip '\'
-            // copy right side of chopped zone
-            strcpy(word, p);
-            // paste parameter
-            strcpy(linePtr, macParms[i + macLevel * MAXMACPARMS]);
-            linePtr = linePtr + strlen(macParms[i + macLevel * MAXMACPARMS]);
-            // paste right side at new linePtr
-            strcpy(linePtr, word);
-        }
-        // handle '\?' unique ID operator
-        else if (token == '\\' && *linePtr == '?')
-        {
-            p = linePtr + 1;    // skip '?'
-            linePtr--;          // skip '\'
-            // make string of number of parameters
-            sprintf(word2, "%.5d", macCurrentID[macLevel]);
-            // copy right side of chopped zone
-            strcpy(word, p);
-            // paste number
-            strcpy(linePtr, word2);
-            linePtr = linePtr + strlen(word2);
-            // paste right side at new linePtr
-            strcpy(linePtr, word);
-        }
-/* just use "\##" instead to avoid any confusion with \\ inside of DB pseudo-op
-        // handle '\\' escape
-        else if (token == '\\' && *linePtr == '\\')
-        {
-            p = linePtr + 1;    // skip second '\'
-            // copy right side of chopped zone
-            strcpy(word, p);
-            // paste right side at new linePtr
-            strcpy(linePtr, word);
-        }
-*/
+            case mt_Parm:
+                parm = macParms[t -> len + macLevel * MAXMACPARMS];
+                len = strlen(parm);
+                break;
 
-        // skip initial whitespace
-        c = *linePtr;
-        while (c == 12 || c == '\t' || c == ' ')
-            c = *++linePtr;
+            case mt_NParms:
+                sprintf(word, "%d", numMacParms[macLevel]);
+                parm = word;
+                len = strlen(word);
+                break;
 
-        p = linePtr;
-        token = GetWord(word);
+            case mt_UniqueID:
+                sprintf(word, "%.5d", macCurrentID[macLevel]);
+                parm = word;
+                len = strlen(word);
+                break;
+
+            case mt_Trim:
+            default:
+                // skip whitespace to the left
+                while (p > s && p[-1] == ' ')
+                    p--;
+                parm = p;
+                len = 0;
+                break;
+        }
+
+        if (len > end - p)
+            len = end - p;
+        memcpy(p, parm, len);
+        p = p + len;
     }
+    *p = 0;
+    linePtr = p;
 }
 
 
@@ -1827,10 +2122,130 @@ int opcode_strcmp(const char *s1, const char *s2)
 }
 
 
+/*
+ *  Opcode table index
+ *
+ *  Each opcode table gets a hash index when its CPU is added, mapping a name to
+ *  the first entry with that name. Entries with a "*" wildcard can't be hashed,
+ *  so they are kept in a list in table order; a wildcard entry wins if it comes
+ *  before the hashed entry, just as in a straight search of the table.
+ */
+
+struct OpcdIndex
+{
+    struct OpcdIndex    *next;      // pointer to next index
+    OpcdPtr             tab;        // opcode table this indexes
+    u_int               size;       // size of hash (power of 2)
+    int                 *hash;      // table entry + 1 for each name, 0 if empty
+    int                 nwild;      // number of wildcard entries
+    int                 *wild;      // table entries with wildcards, in order
+} *opcdIndexTab = NULL;         // pointer to first opcode table index
+typedef struct OpcdIndex *OpcdIndexPtr;
+
+
+OpcdIndexPtr FindOpcdIndex(OpcdPtr tab)
+{
+    static THREAD OpcdIndexPtr last = NULL; // most lookups are in the same table as the last one
+    OpcdIndexPtr p;
+
+    if (last && last -> tab == tab)
+        return last;
+
+    for (p = opcdIndexTab; p; p = p -> next)
+        if (p -> tab == tab)
+            return last = p;
+
+    return NULL;
+}
+
+
+void IndexOpcodeTab(OpcdPtr tab)
+{
+    OpcdIndexPtr    p;
+    int             n,i;
+    u_int           h;
+
+    if (tab == NULL || FindOpcdIndex(tab))
+        return;     // no table, or shared with a CPU already added
+
+    for (n = 0; *(tab[n].name); n++) ;
+
+    p = malloc(sizeof *p);
+    if (p == NULL)
+        return;     // FindOpcodeTab will search the table instead
+    p -> tab   = tab;
+    p -> size  = 64;
+    while (p -> size < (u_int) n * 2)
+        p -> size = p -> size * 2;
+    p -> hash  = calloc(p -> size, sizeof(int));
+    p -> wild  = malloc((n + 1) * sizeof(int));
+    p -> nwild = 0;
+    if (p -> hash == NULL || p -> wild == NULL)
+    {
+        free(p -> hash);
+        free(p -> wild);
+        free(p);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (strchr(tab[i].name, '*'))
+            p -> wild[p -> nwild++] = i;
+        else
+        {
+            h = HashName(tab[i].name) & (p -> size - 1);
+            while (p -> hash[h] && strcmp(tab[p -> hash[h] - 1].name, tab[i].name) != 0)
+                h = (h + 1) & (p -> size - 1);
+            if (p -> hash[h] == 0)  // first one with this name wins
+                p -> hash[h] = i + 1;
+        }
+    }
+
+    p -> next = opcdIndexTab;
+    opcdIndexTab = p;
+}
+
+
 OpcdPtr FindOpcodeTab(OpcdPtr p, char *name, int *typ, int *parm)
 {
+    OpcdIndexPtr    x;
+    int             i,w;
+    u_int           h;
     bool found = FALSE;
 
+    x = FindOpcdIndex(p);
+    if (x)
+    {
+        i = -1;
+        h = HashName(name) & (x -> size - 1);
+        while (x -> hash[h])
+        {
+            if (strcmp(p[x -> hash[h] - 1].name, name) == 0)
+            {
+                i = x -> hash[h] - 1;
+                break;
+            }
+            h = (h + 1) & (x -> size - 1);
+        }
+
+        for (w = 0; w < x -> nwild && (i < 0 || x -> wild[w] < i); w++)
+            if (opcode_strcmp(p[x -> wild[w]].name, name) == 0)
+            {
+                i = x -> wild[w];
+                break;
+            }
+
+        if (i < 0)
+            return NULL;
+
+        *typ  = p[i].typ;
+        *parm = p[i].parm;
+        return &p[i];
+    }
+
+    // no index, search the table
+
 //  while (p -> typ != o_Illegal && !found)
     while (*(p -> name) && !found)
     {
@@ -1901,36 +2316,119 @@ if (pass == 2 && !strcmp(opcode,"FROB"))
 
 
 /*
- *  FindSym
+ *  FindSymSlot
+ *
+ *  returns the symHash slot holding symName, or the empty slot where it would go
  */
 
-SymPtr FindSym(char *symName)
+SymPtr *FindSymSlot(char *symName, u_int hash)
 {
-    SymPtr p = symTab;
-    bool found = FALSE;
+    u_int   i = hash & (symHashSize - 1);
+    SymPtr  p;
 
-    while (p && !found)
+    while ((p = symHash[i]) != NULL)
     {
-        found = (strcmp(p -> name, symName) == 0);
-        if (!found)
-            p = p -> next;
+        if (p -> hash == hash && strcmp(p -> name, symName) == 0)
+            break;
+        i = (i + 1) & (symHashSize - 1);    // linear probing
     }
 
-    return p;
+    return &symHash[i];
 }
 
 
 /*
- *  AddSym
+ *  GrowSymHash
+ *
+ *  doubles the size of symHash, keeping it at most half full
+ */
+
+void GrowSymHash(void)
+{
+    SymPtr  *old = symHash;
+    u_int   oldSize = symHashSize;
+    u_int   i;
+
+    symHashSize = (oldSize == 0) ? SYMHASH_MIN : oldSize * 2;
+    symHash = calloc(symHashSize, sizeof *symHash);
+    if (symHash == NULL)
+    {
+        fprintf(stderr, "%s: out of memory for symbol table\n", progname);
+        exit(1);
+    }
+
+    for (i = 0; i < oldSize; i++)
+        if (old[i])
+            *FindSymSlot(old[i] -> name, old[i] -> hash) = old[i];
+
+    free(old);
+}
+
+
+/*
+ *  FindSym
+ */
+
+SymPtr FindSym(char *symName)
+{
+    if (symHash == NULL)
+        return NULL;
+
+    return *FindSymSlot(symName, HashName(symName));
+}
+
+
+/*
+ *  AllocSym
+ *
+ *  symbols are only freed all at once, so they are carved out of large
+ *  blocks, each starting with a pointer to the previous block
+ */
+
+SymPtr AllocSym(char *symName)
+{
+    size_t  size = sizeof(struct SymRec) + strlen(symName);
+    SymPtr  p;
+
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);  // keep them aligned
+
+    if (size > symArenaLeft)
+    {
+        symArenaLeft = (size > SYM_ARENA) ? size : SYM_ARENA;
+        symArena = malloc(sizeof(char *) + symArenaLeft);
+        if (symArena == NULL)
+        {
+            fprintf(stderr, "%s: out of memory for symbol table\n", progname);
+            exit(1);
+        }
+        *(char **) symArena = symBlocks;
+        symBlocks = symArena;
+        symArena += sizeof(char *);
+    }
+
+    p = (SymPtr) symArena;
+    symArena     += size;
+    symArenaLeft -= size;
+
+    return p;
+}
+
+
+/*
+ *  AddSym
  */
 
 SymPtr AddSym(char *symName)
 {
     SymPtr p;
 
-    p = malloc(sizeof *p + strlen(symName));
+    if (symCount >= symHashSize / 2)
+        GrowSymHash();
+
+    p = AllocSym(symName);
 
     strcpy(p -> name, symName);
+    p -> hash     = HashName(symName);
     p -> value    = 0;
     p -> next     = symTab;
     p -> defined  = FALSE;
@@ -1940,6 +2438,8 @@ SymPtr AddSym(char *symName)
     p -> known    = FALSE;
 
     symTab = p;
+    *FindSymSlot(symName, p -> hash) = p;
+    symCount++;
 
     return p;
 }
@@ -1966,10 +2466,15 @@ int RefSym(char *symName, bool *known)
         switch(pass)
         {
             case 1:
-                if (!p -> defined) *known = FALSE;
+                if (!p -> defined)
+                {
+                    *known = FALSE;
+                    if (onePass) FixupRef(p);
+                }
                 break;
             case 2:
                 if (!p -> known) *known = FALSE;
+                if (curFixup) FixupRefAgain(p, known);
                 break;
         }
 #if 0 // FIXME: possible fix that may be needed for 16-bit address
@@ -1998,6 +2503,7 @@ int RefSym(char *symName, bool *known)
         {
             p = AddSym(symName);
             *known = FALSE;
+            if (onePass) FixupRef(p);
 //          sprintf(s, "Symbol '%s' undefined", symName);
 //          Error(s);
         }
@@ -2038,7 +2544,7 @@ void DefSym(char *symName, u_long val, bool setSym, bool equSym)
             Error(s);
         }
 
-        if (pass == 0 || pass == 2) p -> known = TRUE;
+        if (pass == 0 || (pass == 2 && !curFixup)) p -> known = TRUE;
     }
 }
 
@@ -2156,48 +2662,65 @@ void DumpSymTab(void)
 }
 
 
+/*
+ *  MergeSymLists
+ *
+ *  merges two lists already sorted by name
+ */
+
+SymPtr MergeSymLists(SymPtr a, SymPtr b)
+{
+    struct SymRec   head;   // dummy entry in front of the merged list
+    SymPtr          tail = &head;
+
+    while (a != NULL && b != NULL)
+    {
+        if (strcmp(a->name,b->name) > 0)    // (a->name > b->name)
+        {
+            tail -> next = b;   b = b -> next;
+        }
+        else
+        {
+            tail -> next = a;   a = a -> next;
+        }
+        tail = tail -> next;
+    }
+    tail -> next = (a != NULL) ? a : b;
+
+    return head.next;
+}
+
+
 void SortSymTab()
 {
-    SymPtr          i,j;    // pointers to current elements
-    SymPtr          ip,jp;  // pointers to previous elements
-    SymPtr          t;      // temp for swapping
+    SymPtr          runs[32];   // runs[i] is a sorted list of 2^i symbols, or NULL
+    SymPtr          p,next;
+    int             i;
+
+    // bottom-up merge sort of the linked list, O(n log n)
 
-    // yes, it's a linked-list bubble sort
+    for (i = 0; i < 32; i++)
+        runs[i] = NULL;
 
-    if (symTab != NULL)
+    for (p = symTab; p != NULL; p = next)
     {
-        ip = NULL;  i = symTab;
-        jp = i;     j = i -> next;
+        next = p -> next;
+        p -> next = NULL;
 
-        while (j != NULL)
+        // merge equal sized runs like a binary counter
+        for (i = 0; i < 31 && runs[i] != NULL; i++)
         {
-            while (j != NULL)
-            {
-                if (strcmp(i->name,j->name) > 0)    // (i->name > j->name)
-                {
-                    if (ip != NULL) ip -> next = j;
-                               else symTab     = j;
-                    if (i == jp)
-                    {
-                        i -> next = j -> next;
-                        j -> next = i;
-                    }
-                    else
-                    {
-                        jp -> next = i;
-
-                        t         = i -> next;
-                        i -> next = j -> next;
-                        j -> next = t;
-                    }
-                    t = i; i = j; j = t;
-                }
-                jp = j;     j = j -> next;
-            }
-            ip = i;     i = i -> next;
-            jp = i;     j = i -> next;
+            p = MergeSymLists(runs[i], p);
+            runs[i] = NULL;
         }
+        runs[i] = (i == 31) ? MergeSymLists(runs[i], p) : p;
     }
+
+    p = NULL;
+    for (i = 0; i < 32; i++)
+        p = MergeSymLists(runs[i], p);
+
+    symTab = p;
 }
 
 
@@ -2321,6 +2844,8 @@ int Factor(void)
                     {
                         p = FindSym(word);
                         val = (p && (p -> known || pass == 1));
+                        if (onePass && (curFixup || (p && !p -> defined)))
+                            fixupFail = TRUE;   // result depends on which pass
                     }
                     else IllegalOperand();
                     break;
@@ -2334,6 +2859,8 @@ int Factor(void)
                     {
                         p = FindSym(word);
                         val = !(p && (p -> known || pass == 1));
+                        if (onePass && (curFixup || (p && !p -> defined)))
+                            fixupFail = TRUE;   // result depends on which pass
                     }
                     else IllegalOperand();
                     break;
@@ -2638,12 +3165,15 @@ enum
     REC_CMNT = 3    // comment record
 #endif // CODE_COMMENTS
 };
-    u_char  hex_buf[IHEX_SIZE]; // buffer for current line of object data
-    u_long  hex_len;            // current size of object data buffer
-    u_long  hex_base;           // address of start of object data buffer
-    u_long  hex_addr;           // address of next byte in object data buffer
-    u_short hex_page;           // high word of address for intel hex file
-    u_long  bin_eof;            // current end of file when writing binary file
+    THREAD u_char  hex_buf[IHEX_SIZE];  // buffer for current line of object data
+    THREAD u_long  hex_len;             // current size of object data buffer
+    THREAD u_long  hex_base;            // address of start of object data buffer
+    THREAD u_long  hex_addr;            // address of next byte in object data buffer
+    THREAD u_short hex_page;            // high word of address for intel hex file
+    THREAD u_long  bin_eof;             // current end of file when writing binary file
+    THREAD u_char  *bin_img;            // binary object file image
+    THREAD u_char  *bin_pages;          // bitmap of 256-byte pages written in bin_img
+    THREAD u_long  bin_size;            // allocated size of bin_img
 
 // Intel hex format:
 //
@@ -2765,52 +3295,190 @@ void write_srec(u_long addr, u_char *buf, u_long len, int rectype)
 }
 
 
+// The binary object file is built in memory as an image of the file,
+// filled with 0xFF, and written out with one fwrite by BinWrite. Each
+// -b address window has a fixed place in the file: windows follow one
+// another in the order given, and all but the last one are full size.
+// bin_pages has a bit for each 256-byte page of the file that has had
+// anything written to it.
+
 void write_bin(u_long addr, u_char *buf, u_long len, int rectype)
 {
-    u_long i;
+    u_long  ofs;
+    u_long  size;
+    u_long  pg;
+    u_char  *p;
+    int     w;
 
     if (rectype == REC_DATA)
     {
-        // return if end of data less than base address
-        if (addr + len <= cl_Binbase) return;
+        ofs = 0;
+        for (w = 0; w < cl_BinWins; w++)
+        {
+            u_long  base = cl_Binbase[w];
+            u_long  end  = cl_Binend[w];
+            u_long  n    = len;
+            u_char  *b   = buf;
+            u_long  a    = addr;
+
+            // skip this window if the data is entirely outside it
+            if (a + n > base && a <= end)
+            {
+                // if data crosses base address, adjust start of data
+                if (a < base)
+                {
+                    b = b + base - a;
+                    n = n - (base - a);
+                    a = base;
+                }
 
-        // return if start of data greater than end address
-        if (addr > cl_Binend) return;
+                // if data crossses end address, adjust length of data
+                if (a+n-1 > end)
+                    n = end - a + 1;
 
-        // if data crosses base address, adjust start of data
-        if (addr < cl_Binbase)
-        {
-            buf = buf + cl_Binbase - addr;
-            addr = cl_Binbase;
-        }
+                // grow the image if needed, padding with 0xFF
+                size = ofs + a - base + n;
+                if (size > bin_size)
+                {
+                    u_long newSize = bin_size ? bin_size : BIN_IMGMIN;
+                    while (newSize < size)
+                        newSize = newSize * 2;
+                    p = realloc(bin_img, newSize);
+                    if (p == NULL)
+                    {
+                        fprintf(stderr,"%s: Out of memory for binary object file\n",progname);
+                        exit(1);
+                    }
+                    bin_img = p;
+                    memset(bin_img + bin_size, 0xFF, newSize - bin_size);
+                    p = realloc(bin_pages, newSize / 2048);
+                    if (p == NULL)
+                    {
+                        fprintf(stderr,"%s: Out of memory for binary object file\n",progname);
+                        exit(1);
+                    }
+                    bin_pages = p;
+                    memset(bin_pages + bin_size / 2048, 0, (newSize - bin_size) / 2048);
+                    bin_size = newSize;
+                }
 
-        // if data crossses end address, adjust length of data
-        if (addr+len-1 > cl_Binend)
-            len = cl_Binend - addr + 1;
+                // copy the data into the image and mark its pages
+                memcpy(bin_img + ofs + a - base, b, n);
+                for (pg = (ofs + a - base) >> 8; pg <= (ofs + a - base + n - 1) >> 8; pg++)
+                    bin_pages[pg >> 3] |= 1 << (pg & 7);
 
-        // if addr is beyond current EOF, write (addr-bin_eof) bytes of 0xFF padding
-        if (addr - cl_Binbase > bin_eof)
-        {
-            fseek(object, bin_eof, SEEK_SET);
-            for (i=0; i < addr - cl_Binbase - bin_eof; i++)
-                fputc(0xFF, object);
+                // update EOF of object file
+                if (ofs + a - base + n > bin_eof)
+                    bin_eof = ofs + a - base + n;
+            }
+
+            ofs = ofs + end - base + 1;
         }
+    }
+}
+
+
+/*
+ *  BinFree frees the binary object file image
+ */
+
+void BinFree(void)
+{
+    free(bin_img);
+    free(bin_pages);
+    bin_img   = NULL;
+    bin_pages = NULL;
+    bin_size  = 0;
+    bin_eof   = 0;
+}
+
+
+/*
+ *  BinWrite writes the binary object file image
+ */
+
+void BinWrite(void)
+{
+    if (bin_eof)
+        fwrite(bin_img, 1, bin_eof, object);
+
+    BinFree();
+}
+
+
+/*
+ *  ST2Page is TRUE if page pg of the image goes in the .st2 file
+ */
+
+int ST2Page(u_long pg)
+{
+    u_long addr = ST2_BASE + pg * 256;
+
+    return ((bin_pages[pg >> 3] >> (pg & 7)) & 1) && (addr < ST2_RAM || addr > ST2_RAMEND);
+}
+
+
+/*
+ *  ST2Write writes the binary object file image as an RCA Studio II
+ *  .st2 cartridge file: a 256-byte header, then each page that
+ *  anything was written to. The header holds "RCA2", the number of
+ *  256-byte blocks in the file, the format version and video driver,
+ *  the author and dumper IDs, the catalogue code and title strings,
+ *  and at offset 64 the high byte of the address of each page.
+ *  Pages in the console's RAM are left out; CodeOut has already
+ *  reported an error for them. With -b as well, the whole image is
+ *  also written to cl_BinName.
+ */
 
-        // seek to addr and write buf
-        fseek(object, addr - cl_Binbase, SEEK_SET);
-        fwrite(buf, 1, len, object);
+void ST2Write(void)
+{
+    u_char  hdr[256];
+    u_long  pg;
+    int     n;
+    FILE    *bin;
 
-        // update EOF of object file
-        i = ftell(object);
-        if (i > bin_eof)
-            bin_eof = i;
+    memset(hdr, 0, sizeof hdr);
+    memcpy(hdr, "RCA2", 4);
+    hdr[5] = 1;                     // format version
+    hdr[6] = 0;                     // standard video driver
+    memcpy(hdr +  8, st2Author, 2);
+    memcpy(hdr + 10, st2Dumper, 2);
+    strcpy((char *) hdr + 16, st2Cat);
+    strcpy((char *) hdr + 32, st2Title);
 
-        //fflush(object);
+    n = 0;
+    for (pg = 0; pg < bin_size / 256; pg++)
+        if (ST2Page(pg))
+            hdr[64 + n++] = (ST2_BASE + pg * 256) >> 8;
+    hdr[4] = n + 1;
+
+    fwrite(hdr, 1, sizeof hdr, object);
+    for (pg = 0; pg < bin_size / 256; pg++)
+        if (ST2Page(pg))
+            fwrite(bin_img + pg * 256, 1, 256, object);
+
+    // with -b, the image also goes in a binary file, the same as -b $400-$FFF
+    if (cl_ST2Bin)
+    {
+        bin = fopen(cl_BinName, "wb");
+        if (bin == NULL)
+        {
+            fprintf(stderr,"Unable to create binary output file '%s'!\n",cl_BinName);
+            errCount++;
+        }
+        else
+        {
+            if (bin_eof)
+                fwrite(bin_img, 1, bin_eof, bin);
+            fclose(bin);
+        }
     }
+
+    BinFree();
 }
 
 
-u_char trs_buf[256]; // buffer for current object code data, used instead of hex_buf
+THREAD u_char   trs_buf[256];       // buffer for current object code data, used instead of hex_buf
 
 void write_trsdos(u_long addr, u_char *buf, u_long len, int rectype)
 {
@@ -2895,6 +3563,7 @@ void write_hex(u_long addr, u_char *buf, u_long len, int rectype)
             case OBJ_S9:     write_srec  (addr, buf, len, rectype); break;
             case OBJ_BIN:    write_bin   (addr, buf, len, rectype); break;
             case OBJ_TRSDOS: write_trsdos(addr, buf, len, rectype); break;
+            case OBJ_ST2:    write_bin   (addr, buf, len, rectype); break;
         }
     }
 }
@@ -2912,6 +3581,12 @@ void CodeInit(void)
 
 void CodeFlush(void)
 {
+    if (onePass)
+    {
+        ImageBreak();
+        return;
+    }
+
     if (hex_len)
     {
         write_hex(hex_base, hex_buf, hex_len, REC_DATA);
@@ -2924,7 +3599,14 @@ void CodeFlush(void)
 
 void CodeOut(int byte)
 {
-    if (pass == 2)
+    if (cl_Obj && cl_ObjType == OBJ_ST2 && codPtr >= ST2_RAM && codPtr <= ST2_RAMEND && !errFlag)
+        Error("Code in Studio II RAM can not go in a cartridge");
+
+    if (onePass)
+        ImageOut(byte);
+    else if (pass == 2 && asmxCtx)
+        LibCodeOut(byte);
+    else if (pass == 2)
     {
         if (codPtr != hex_addr)
         {
@@ -2981,6 +3663,11 @@ void CodeEnd(void)
     {
         if (xferFound)
             write_hex(xferAddr, hex_buf, 0, REC_XFER);
+
+        if (cl_Obj && cl_ObjType == OBJ_BIN)
+            BinWrite();
+        if (cl_Obj && cl_ObjType == OBJ_ST2)
+            ST2Write();
     }
 }
 
@@ -3356,21 +4043,253 @@ void SwitchSeg(SegPtr seg)
 // text I/O
 
 
+/*
+ *  SplitSrcFile
+ *
+ *  Source and include files are read into memory once and split into lines,
+ *  then every pass (and every INCLUDE of the same file) reads from the cached
+ *  copy. Lines end with LF, CR-LF, or CR; an unterminated last line is kept
+ *  only if it isn't empty.
+ *
+ *  SplitSrcFile takes over text, which must have room for a null after the
+ *  len characters. Returns NULL if out of memory.
+ */
+
+SrcFilePtr SplitSrcFile(char *fname, char *text, size_t len)
+{
+    SrcFilePtr  p;
+    char        *q, *end;
+    int         nlines;
+
+    text[len] = 0;
+    end = text + len;
+
+    // count the lines, an upper bound if there are CR-LF pairs
+    nlines = 1;
+    for (q = text; q < end; q++)
+        if (*q == '\n' || *q == '\r')
+            nlines++;
+
+    p = malloc(sizeof *p + strlen(fname));
+    if (p)
+        p -> lines = malloc(nlines * sizeof(char *));
+    if (p == NULL || p -> lines == NULL)
+    {
+        free(p);
+        free(text);
+        return NULL;
+    }
+
+    // split into lines
+    p -> text   = text;
+    p -> nlines = 0;
+    q = text;
+    while (q < end)
+    {
+        p -> lines[p -> nlines++] = q;
+        while (q < end && *q != '\n' && *q != '\r')
+            q++;
+        if (q < end)
+        {
+            if (*q == '\r' && q + 1 < end && q[1] == '\n')
+                *q++ = 0;
+            *q++ = 0;
+        }
+    }
+
+    strcpy(p -> name, fname);
+    p -> next = NULL;
+
+    return p;
+}
+
+
+/*
+ *  ReadSrcText
+ *
+ *  reads a whole source or include file into memory, with room for a null
+ *  after it, or gets it from the library caller. Returns NULL if the file
+ *  can't be read.
+ */
+
+char *ReadSrcText(char *fname, long *len)
+{
+    FILE        *f;
+    const char  *src;
+    char        *text, *q;
+    size_t      size, n;
+
+    if (asmxCtx)
+    {
+        src = LibInclude(fname, len);
+        if (src == NULL)
+            return NULL;
+        text = malloc(*len + 1);
+        if (text)
+            memcpy(text, src, *len);
+        return text;
+    }
+
+    f = fopen(fname, "r");
+    if (f == NULL)
+        return NULL;
+
+    // read the whole file
+    *len = 0;
+    size = 65536;
+    text = malloc(size + 1);
+    while (text && (n = fread(text + *len, 1, size - *len, f)) > 0)
+    {
+        *len = *len + n;
+        if (*len == size)
+        {
+            size = size * 2;
+            q = realloc(text, size + 1);
+            if (q == NULL)
+                free(text);
+            text = q;
+        }
+    }
+    fclose(f);
+
+    return text;
+}
+
+
+/*
+ *  FindSrcFile returns the cached copy of fname in tab, or NULL
+ */
+
+SrcFilePtr FindSrcFile(SrcFilePtr tab, char *fname)
+{
+    while (tab && strcmp(tab -> name, fname) != 0)
+        tab = tab -> next;
+
+    return tab;
+}
+
+
+/*
+ *  LoadSrcFile
+ *
+ *  returns the cached copy of a source or include file, reading it (or
+ *  getting it from the library caller) the first time. Returns NULL if
+ *  the file can't be read.
+ *
+ *  On the command line the cache is shared by all batch threads, keyed
+ *  by path. The file is read without holding the lock, so if two threads
+ *  read the same path at once the first copy to be added is kept.
+ */
+
+SrcFilePtr LoadSrcFile(char *fname)
+{
+    SrcFilePtr  p, q, *tab;
+    char        *text;
+    long        len;
+
+    tab = asmxCtx ? &srcFileTab : &srcFileCache;
+
+    LockBatch();
+    p = FindSrcFile(*tab, fname);
+    UnlockBatch();
+    if (p)
+        return p;
+
+    text = ReadSrcText(fname, &len);
+    if (text == NULL)
+        return NULL;
+    p = SplitSrcFile(fname, text, len);
+    if (p == NULL)
+        return NULL;
+
+    LockBatch();
+    q = FindSrcFile(*tab, fname);
+    if (q == NULL)
+    {
+        p -> next = *tab;
+        *tab = p;
+    }
+    UnlockBatch();
+
+    if (q)
+    {   // another thread got there first
+        free(p -> text);
+        free(p -> lines);
+        free(p);
+        p = q;
+    }
+
+    return p;
+}
+
+
+/*
+ *  IncPath
+ *
+ *  makes the n'th name to try for an INCLUDE or INCBIN file: first in the
+ *  directory of the file doing the including, then in the directory of the
+ *  main source file, then as it is (the current directory). An absolute
+ *  name, or one from the library caller, is only tried as it is.
+ *  Returns FALSE when there are no more names to try.
+ */
+
+bool IncPath(char *fname, int n, char *path)
+{
+    char    *dir;
+    char    *p;
+    int     len;
+
+    if (asmxCtx || fname[0] == '/' || fname[0] == '\\' || (fname[0] && fname[1] == ':'))
+        n = n + 2;
+
+    switch(n)
+    {
+        case 0:  dir = (nInclude >= 0) ? incname[nInclude] : cl_SrcName; break;
+        case 1:  dir = cl_SrcName; break;
+        case 2:  strcpy(path, fname); return TRUE;
+        default: return FALSE;
+    }
+
+    len = 0;
+    for (p = dir; *p; p++)
+        if (*p == '/' || *p == '\\')
+            len = p + 1 - dir;
+
+    if (len + strlen(fname) > 255)
+        len = 0;
+
+    memcpy(path, dir, len);
+    strcpy(path + len, fname);
+
+    return TRUE;
+}
+
+
 int OpenInclude(char *fname)
 {
+    Str255  path;
+    int     i;
+
     if (nInclude == MAX_INCLUDE - 1)
         return -1;
 
+    // try each place in turn, skipping a name that was just tried
+    include[nInclude + 1] = NULL;
+    incname[nInclude + 1][0] = 0;
+    for (i = 0; include[nInclude + 1] == NULL && IncPath(fname, i, path); i++)
+        if (strcmp(path, incname[nInclude + 1]) != 0)
+        {
+            strcpy(incname[nInclude + 1], path);
+            include[nInclude + 1] = LoadSrcFile(path);
+        }
+
+    if (include[nInclude + 1] == NULL)
+        return 0;
+
     nInclude++;
-    include[nInclude] = NULL;
+    incPos[nInclude]  = 0;
     incline[nInclude] = 0;
-    strcpy(incname[nInclude],fname);
-    include[nInclude] = fopen(fname, "r");
-    if (include[nInclude])
-        return 1;
-
-    nInclude--;
-    return 0;
+    return 1;
 }
 
 
@@ -3379,16 +4298,15 @@ void CloseInclude(void)
     if (nInclude < 0)
         return;
 
-    fclose(include[nInclude]);
     include[nInclude] = NULL;
     nInclude--;
 }
 
 
-int ReadLine(FILE *file, char *line, int max)
+int ReadLine(SrcFilePtr file, int *pos, char *line, int max)
 {
-    int c = 0;
-    int len = 0;
+    char            *p;
+    MacroLinePtr    mline;
 
     macLineFlag = TRUE;
 
@@ -3414,9 +4332,9 @@ int ReadLine(FILE *file, char *line, int max)
     // if there is still another macro line to process, get it
     if (macLine[macLevel] != NULL)
     {
-        strcpy(line, macLine[macLevel] -> text);
+        mline = macLine[macLevel];
         macLine[macLevel] = macLine[macLevel] -> next;
-        DoMacParms();
+        DoMacParms(mline, line, max);
     }
     else
     {   // else we weren't in a macro or we just ran out of macro
@@ -3429,33 +4347,20 @@ int ReadLine(FILE *file, char *line, int max)
 
         macPtr[macLevel] = NULL;
 
-        while (max > 1)
+        if (*pos >= file -> nlines)
         {
-            c = fgetc(file);
             *line = 0;
-            switch(c)
-            {
-                case EOF:
-                    if (len == 0) return 0;
-                case '\n':
-                    return 1;
-                case '\r':
-                    c = fgetc(file);
-                    if (c != '\n')
-                    {
-                        ungetc(c,file);
-                        c = '\r';
-                    }
-                    return 1;
-                default:
-                    *line++ = c;
-                    max--;
-                    len++;
-                    break;
-            }
+            return 0;
+        }
+
+        // copy the line, truncated to fit
+        p = file -> lines[(*pos)++];
+        while (max > 1 && *p)
+        {
+            *line++ = *p++;
+            max--;
         }
-        while (c != EOF && c != '\n')
-            c = fgetc(file);
+        *line = 0;
     }
     return 1;
 }
@@ -3467,13 +4372,13 @@ int ReadSourceLine(char *line, int max)
 
     while (nInclude >= 0)
     {
-        i = ReadLine(include[nInclude], line, max);
+        i = ReadLine(include[nInclude], &incPos[nInclude], line, max);
         if (i) return i;
 
         CloseInclude();
     }
 
-    return ReadLine(source, line, max);
+    return ReadLine(source, &sourcePos, line, max);
 }
 
 
@@ -3486,10 +4391,17 @@ void ListOut(bool showStdErr)
     Debright(listLine);
 
     if (cl_List)
-        fprintf(listing,"%s\n",listLine);
+    {
+        TextOut(listing, listLine);
+        TextOut(listing, "\n");
+    }
 
-    if (pass == 2 && showStdErr && ((errFlag && cl_Err) || (warnFlag && cl_Warn)))
-        fprintf(stderr,"%s\n",listLine);
+    if (outPass && showStdErr && (errFlag || warnFlag)
+                && ((errFlag && cl_Err) || (warnFlag && cl_Warn) || asmxCtx))
+    {
+        TextOut(stderr, listLine);
+        TextOut(stderr, "\n");
+    }
 }
 
 
@@ -3918,7 +4830,7 @@ void DoOpcode(int typ, int parm)
                 token = 0;
             }
 
-            if (pass == 2)
+            if (outPass)
             {
                 showAddr = FALSE;
 
@@ -4066,7 +4978,7 @@ void DoOpcode(int typ, int parm)
                     val = 0;
             }
 
-            if (pass == 2)
+            if (outPass)
             {
                 showAddr = FALSE;
 
@@ -4136,6 +5048,26 @@ void DoOpcode(int typ, int parm)
             else if (!SetCPU(word)) IllegalOperand();
             break;
 
+        case o_ST2:
+            GetFName(word);
+            if (word[0] == 0) MissingOperand();
+            else
+            {
+                switch(parm)
+                {
+                    default:
+                    case 0: p = st2Author; n = sizeof st2Author; break;
+                    case 1: p = st2Dumper; n = sizeof st2Dumper; break;
+                    case 2: p = st2Cat;    n = sizeof st2Cat;    break;
+                    case 3: p = st2Title;  n = sizeof st2Title;  break;
+                }
+                if (strlen(word) >= n)
+                    Error("String too long");
+                else
+                    strcpy(p, word);
+            }
+            break;
+
         default:
             Error("Unknown opcode");
             break;
@@ -4209,7 +5141,7 @@ void DoLabelOp(int typ, int parm, char *labl)
             CodeRelOrg(val);
             DefSym(labl,codPtr,FALSE,FALSE);
 
-            if (pass == 2)
+            if (outPass)
             {
                 // "XXXX = XXXX"
                 p = ListLoc(codPtr);
@@ -4238,7 +5170,7 @@ void DoLabelOp(int typ, int parm, char *labl)
             break;
 
         case o_REND:
-            if (pass == 2)
+            if (outPass)
             {
                 // "XXXX = XXXX"
                 p = ListLoc(locPtr);
@@ -4354,6 +5286,11 @@ void DoLabelOp(int typ, int parm, char *labl)
                 if (macro == NULL)
                 {
                     macro = AddMacro(labl);
+                    if (macro == NULL)
+                    {
+                        Error("Out of memory for macro");
+                        break;
+                    }
                     nparms = 0;
 
                     token = GetWord(word);
@@ -4376,7 +5313,7 @@ void DoLabelOp(int typ, int parm, char *labl)
                         Error("Illegal operand");
                 }
 
-                if (pass == 2)
+                if (outPass)
                 {
                     macro -> def = TRUE;
                     if (macro -> toomany)
@@ -4387,7 +5324,7 @@ void DoLabelOp(int typ, int parm, char *labl)
                 i = ReadSourceLine(line, sizeof(line));
                 while (i && typ != o_ENDM)
                 {
-                    if ((pass == 2 || cl_ListP1) && (listFlag || errFlag))
+                    if ((outPass || cl_ListP1) && (listFlag || errFlag))
                         ListOut(TRUE);
                     CopyListLine();
 
@@ -4576,7 +5513,7 @@ void DoLabelOp(int typ, int parm, char *labl)
                 i = ReadSourceLine(line, sizeof(line));
                 while (i && typ != o_REPEND)
                 {
-                    if ((pass == 2 || cl_ListP1) && (listFlag || errFlag))
+                    if ((outPass || cl_ListP1) && (listFlag || errFlag))
                         ListOut(TRUE);
                     CopyListLine();
 
@@ -4691,8 +5628,38 @@ void DoLabelOp(int typ, int parm, char *labl)
 
             val = 0;
 
-            // open binary file
-            incbin = fopen(word, "r");
+            if (asmxCtx)
+            {   // the library caller has the file
+                const char  *bin;
+                long        binLen;
+
+                bin = LibInclude(word, &binLen);
+                if (bin)
+                {
+                    for (val = 0; val < binLen; val++)
+                        CodeOut((u_char) bin[val]);
+
+                    if (outPass)
+                    {
+                        // "XXXX  (XXXX)"
+                        p = ListLoc(locPtr-val);
+                        *p++ = ' ';
+                        *p++ = '(';
+                        p = ListAddr(p,val);
+                        *p++ = ')';
+                    }
+                }
+                else
+                {
+                    sprintf(s,"Unable to open INCBIN file '%s'",word);
+                    Error(s);
+                }
+                break;
+            }
+
+            // open binary file, looking in the same places as INCLUDE
+            for (i = 0; incbin == NULL && IncPath(word, i, s); i++)
+                incbin = fopen(s, "r");
 
             if (incbin)
             {
@@ -4711,7 +5678,7 @@ void DoLabelOp(int typ, int parm, char *labl)
                 if (n<0)
                     sprintf(s,"Error reading INCBIN file '%s'",word);
 
-                if (pass == 2)
+                if (outPass)
                 {
                     // "XXXX  (XXXX)"
                     p = ListLoc(locPtr-val);
@@ -4906,7 +5873,7 @@ void DoLine()
             }
         }
 
-        if ((pass == 2 || cl_ListP1) && listThisLine && (errFlag || listMacFlag || !macLineFlag))
+        if ((outPass || cl_ListP1) && listThisLine && (errFlag || listMacFlag || !macLineFlag))
             ListOut(TRUE);
     }
     else
@@ -4963,13 +5930,14 @@ void DoLine()
                 DefSym(labl,locPtr,FALSE,FALSE);
                 DoOpcode(typ, parm);
             }
+            lineTyp = typ;
 
             if (typ != o_Illegal && typ != o_MacName)
                 if (!errFlag && GetWord(word))
                     Error("Too many operands");
         }
 
-        if (pass == 1 && !cl_ListP1)
+        if (!outPass && !cl_ListP1)
             AddLocPtr(abs(instrLen));
         else
         {
@@ -5099,6 +6067,488 @@ void DoLine()
 }
 
 
+// --------------------------------------------------------------
+// one-pass assembly
+
+
+/*
+ *  One-pass mode (-p)
+ *
+ *  The source is read once, as pass 1, but the listing, screen messages
+ *  and object code are made as pass 2 would make them, and kept in memory.
+ *  A line that uses a symbol not yet defined is kept as a fixup. When the
+ *  pass is done, each fixup line is assembled again, and its code and
+ *  listing replace what the first try made. If a fixup line does more than
+ *  make code, or makes a different size of code, or there is an error
+ *  outside a fixup line, what was kept is thrown away. The rest of the
+ *  source is then read as an ordinary pass 1, and pass 2 follows as usual.
+ */
+
+THREAD FixupPtr fixupLast;          // last fixup in fixupTab
+
+THREAD struct TextBuf
+{
+    char                *text;      // text written so far
+    long                len;        // length of text
+    long                size;       // size of text buffer
+    long                passEnd;    // len at the end of the pass
+} listText, errText;            // listing and screen output
+
+THREAD u_char   *imgData;           // object code image
+THREAD long     imgLen;             // bytes in imgData
+THREAD long     imgSize;            // size of imgData
+THREAD struct ImgRun
+{
+    u_long              addr;       // address of first byte
+    long                start;      // offset in imgData
+} *imgRun;                      // runs of consecutive addresses in the image
+THREAD int      imgRuns;            // number of runs
+THREAD int      imgRunSize;         // size of imgRun
+THREAD bool     imgBreak;           // TRUE to start a new run, like a new hex record
+THREAD u_long   imgNext;            // address after the last byte in the image
+THREAD long     imgPatch;           // next byte to patch when reassembling a fixup
+
+// state at the start of the current line
+THREAD Str255   fixLine;
+THREAD Str255   fixLastLabl;
+THREAD Str255   fixSubrLabl;
+THREAD u_long   fixLoc;
+THREAD u_long   fixCod;
+THREAD long     fixImg;
+THREAD long     fixListPos;
+THREAD long     fixErrPos;
+THREAD int      fixErrCount;
+THREAD bool     fixMacLineFlag;
+THREAD int      fixNFwd;
+THREAD SymPtr   fixFwd[MAX_FWDREF];
+
+
+/*
+ *  TextOut writes listing or screen text, or saves it for later
+ *  in one-pass mode
+ */
+
+void TextOut(FILE *f, char *s)
+{
+    struct TextBuf  *t;
+    char            *p;
+    long            len;
+
+    if (asmxCtx)
+    {   // messages go to the library caller, and there is no listing
+        if (f == stderr && asmxCtx -> message)
+            asmxCtx -> message(asmxCtx -> user, s);
+        return;
+    }
+
+    if (!onePass)
+    {
+        fputs(s, f);
+        return;
+    }
+
+    t = (f == listing) ? &listText : &errText;
+    len = strlen(s);
+    if (t -> len + len > t -> size)
+    {
+        t -> size = t -> size ? t -> size * 2 : 65536;
+        while (t -> len + len > t -> size)
+            t -> size = t -> size * 2;
+        p = realloc(t -> text, t -> size);
+        if (p == NULL)
+        {
+            fixupFail = TRUE;
+            return;
+        }
+        t -> text = p;
+    }
+    memcpy(t -> text + t -> len, s, len);
+    t -> len = t -> len + len;
+}
+
+
+/*
+ *  ImageOut puts a byte of object code into the image, or patches
+ *  the code of a fixup line which is being reassembled
+ */
+
+void ImageOut(int byte)
+{
+    u_char          *p;
+    struct ImgRun   *r;
+
+    if (curFixup)
+    {
+        if (imgPatch < curFixup -> img + curFixup -> imgLen)
+            imgData[imgPatch] = byte;
+        imgPatch++;
+        return;
+    }
+
+    if (imgLen == imgSize)
+    {
+        imgSize = imgSize ? imgSize * 2 : 65536;
+        p = realloc(imgData, imgSize);
+        if (p == NULL)
+        {
+            fixupFail = TRUE;
+            return;
+        }
+        imgData = p;
+    }
+
+    if (imgBreak || imgRuns == 0 || codPtr != imgNext)
+    {
+        if (imgRuns == imgRunSize)
+        {
+            imgRunSize = imgRunSize ? imgRunSize * 2 : 64;
+            r = realloc(imgRun, imgRunSize * sizeof *r);
+            if (r == NULL)
+            {
+                fixupFail = TRUE;
+                return;
+            }
+            imgRun = r;
+        }
+        imgRun[imgRuns].addr  = codPtr;
+        imgRun[imgRuns].start = imgLen;
+        imgRuns++;
+        imgBreak = FALSE;
+    }
+
+    imgData[imgLen++] = byte;
+    imgNext = codPtr + 1;
+}
+
+
+/*
+ *  ImageBreak starts a new run in the image where the object code
+ *  would have been flushed
+ */
+
+void ImageBreak(void)
+{
+    if (!curFixup)
+        imgBreak = TRUE;
+}
+
+
+/*
+ *  FixupRef notes a reference to a symbol that isn't defined yet
+ */
+
+void FixupRef(SymPtr p)
+{
+    int i;
+
+    if (curFixup)
+        return;
+
+    for (i = 0; i < fixNFwd; i++)
+        if (fixFwd[i] == p)
+            return;
+
+    if (fixNFwd < MAX_FWDREF)
+        fixFwd[fixNFwd++] = p;
+    else
+        fixupFail = TRUE;
+}
+
+
+/*
+ *  FixupRefAgain makes a symbol unknown when a fixup line is reassembled
+ *  if it was defined after that line, just as pass 2 would
+ */
+
+void FixupRefAgain(SymPtr p, bool *known)
+{
+    int i;
+
+    // the value of a SET symbol may have changed since the line
+    if (p -> isSet)
+        fixupFail = TRUE;
+
+    *known = TRUE;
+    for (i = 0; i < curFixup -> nfwd; i++)
+        if (curFixup -> fwd[i] == p)
+            *known = FALSE;
+}
+
+
+/*
+ *  OnePassFree frees the saved listing, fixups and code image
+ */
+
+void OnePassFree(void)
+{
+    FixupPtr    p;
+
+    free(listText.text);
+    free(errText.text);
+    memset(&listText, 0, sizeof listText);
+    memset(&errText, 0, sizeof errText);
+
+    while (fixupTab)
+    {
+        p = fixupTab;
+        fixupTab = p -> next;
+        free(p);
+    }
+    fixupLast = NULL;
+
+    free(imgData);
+    free(imgRun);
+    imgData    = NULL;
+    imgRun     = NULL;
+    imgLen     = 0;
+    imgSize    = 0;
+    imgRuns    = 0;
+    imgRunSize = 0;
+}
+
+
+/*
+ *  OnePassFail gives up on one-pass mode
+ */
+
+void OnePassFail(void)
+{
+    MacroPtr    m;
+
+    onePass  = FALSE;
+    outPass  = FALSE;
+    curFixup = NULL;
+
+    OnePassFree();
+
+    // macros are marked as defined in pass 2
+    for (m = macroTab; m; m = m -> next)
+        m -> def = FALSE;
+}
+
+
+/*
+ *  FixupLineStart saves the state needed to reassemble the current line
+ */
+
+void FixupLineStart(void)
+{
+    strcpy(fixLine, line);
+    strcpy(fixLastLabl, lastLabl);
+    strcpy(fixSubrLabl, subrLabl);
+    fixLoc         = locPtr;
+    fixCod         = codPtr;
+    fixImg         = imgLen;
+    fixListPos     = listText.len;
+    fixErrPos      = errText.len;
+    fixErrCount    = errCount;
+    fixMacLineFlag = macLineFlag;
+    fixNFwd        = 0;
+    fixupFail      = FALSE;
+    lineTyp        = o_Illegal;
+}
+
+
+/*
+ *  FixupLineEnd makes a fixup if the line used any forward references
+ */
+
+void FixupLineEnd(void)
+{
+    FixupPtr    p;
+    char        *fname;
+    int         lnum;
+    int         len;
+
+    if (fixupFail)
+    {
+        OnePassFail();
+        return;
+    }
+
+    if (fixNFwd == 0)
+    {
+        if (errFlag)
+            OnePassFail();
+        return;
+    }
+
+    // only lines that generate code can be fixed up, and only
+    // if the CPU doesn't keep any state from line to line
+    if (!(lineTyp < o_Illegal || (o_DB <= lineTyp && lineTyp <= o_ASCIIZ && lineTyp != o_DS))
+        || (curAsm && curAsm -> PassInit))
+    {
+        OnePassFail();
+        return;
+    }
+
+    fname = NULL;
+    lnum  = linenum;
+    if (nInclude >= 0)
+    {
+        fname = include[nInclude] -> name;
+        lnum  = incline[nInclude];
+    }
+
+    len = strlen(fixLine) + strlen(fixLastLabl) + strlen(fixSubrLabl) + 2;
+    p = malloc(sizeof *p + len);
+    if (p == NULL)
+    {
+        OnePassFail();
+        return;
+    }
+
+    p -> next          = NULL;
+    p -> loc           = fixLoc;
+    p -> cod           = fixCod;
+    p -> locEnd        = locPtr;
+    p -> img           = fixImg;
+    p -> imgLen        = imgLen - fixImg;
+    p -> list.pos      = fixListPos;
+    p -> list.end      = listText.len;
+    p -> err.pos       = fixErrPos;
+    p -> err.end       = errText.len;
+    p -> cpu           = curCpuPtr;
+    p -> fname         = fname;
+    p -> linenum       = lnum;
+    p -> listFlag      = listFlag;
+    p -> listMacFlag   = listMacFlag;
+    p -> expandHexFlag = expandHexFlag;
+    p -> macLineFlag   = fixMacLineFlag;
+    p -> nfwd          = fixNFwd;
+    memcpy(p -> fwd, fixFwd, fixNFwd * sizeof(SymPtr));
+    strcpy(p -> text, fixLine);
+    p -> lastLabl = p -> text + strlen(p -> text) + 1;
+    strcpy(p -> lastLabl, fixLastLabl);
+    p -> subrLabl = p -> lastLabl + strlen(p -> lastLabl) + 1;
+    strcpy(p -> subrLabl, fixSubrLabl);
+
+    if (fixupLast)
+        fixupLast -> next = p;
+    else
+        fixupTab = p;
+    fixupLast = p;
+
+    // errors from this line will come from reassembling it
+    errCount = fixErrCount;
+}
+
+
+/*
+ *  TextWrite writes out the saved text, with the new text for each fixup line
+ */
+
+void TextWrite(struct TextBuf *t, FILE *f)
+{
+    FixupPtr            p;
+    struct FixupText    *q;
+    long                pos;
+
+    pos = 0;
+    for (p = fixupTab; p; p = p -> next)
+    {
+        q = (t == &listText) ? &p -> list : &p -> err;
+        fwrite(t -> text + pos, 1, q -> pos - pos, f);
+        fwrite(t -> text + q -> newPos, 1, q -> newEnd - q -> newPos, f);
+        pos = q -> end;
+    }
+    fwrite(t -> text + pos, 1, t -> passEnd - pos, f);
+}
+
+
+/*
+ *  OnePassFinish reassembles the fixup lines and writes the output,
+ *  returns FALSE if pass 2 is needed after all
+ */
+
+bool OnePassFinish(void)
+{
+    FixupPtr    p;
+    long        i,n;
+    int         r;
+
+    if (!onePass)
+        return FALSE;
+
+    listText.passEnd = listText.len;
+    errText.passEnd  = errText.len;
+
+    // reassemble each fixup line as pass 2, appending its new listing text
+    pass = 2;
+    for (p = fixupTab; p; p = p -> next)
+    {
+        curFixup  = p;
+        fixupFail = FALSE;
+
+        if (curCpuPtr != p -> cpu)
+            SetCPU(p -> cpu -> name);
+        locPtr = p -> loc;
+        codPtr = p -> cod;
+        strcpy(lastLabl, p -> lastLabl);
+        strcpy(subrLabl, p -> subrLabl);
+        listFlag      = p -> listFlag;
+        listMacFlag   = p -> listMacFlag;
+        expandHexFlag = p -> expandHexFlag;
+        macLineFlag   = p -> macLineFlag;
+        condLevel     = 0;
+        condState[0]  = condTRUE;
+        if (p -> fname)
+        {
+            nInclude = 0;
+            strcpy(incname[0], p -> fname);
+            incline[0] = p -> linenum;
+        }
+        else
+        {
+            nInclude = -1;
+            linenum  = p -> linenum;
+        }
+
+        p -> list.newPos = listText.len;
+        p -> err.newPos  = errText.len;
+        imgPatch = p -> img;
+
+        strcpy(line, p -> text);
+        DoLine();
+
+        p -> list.newEnd = listText.len;
+        p -> err.newEnd  = errText.len;
+
+        if (fixupFail || imgPatch != p -> img + p -> imgLen || locPtr != p -> locEnd)
+        {
+            OnePassFail();
+            pass = 1;
+            return FALSE;
+        }
+    }
+    curFixup = NULL;
+    nInclude = -1;
+
+    // write out the listing and messages, then the object code as pass 2 would have
+    if (cl_List)
+        TextWrite(&listText, listing);
+    TextWrite(&errText, stderr);
+
+    onePass = FALSE;
+    CodeHeader(cl_SrcName);
+    for (r = 0; r < imgRuns; r++)
+    {
+        CodeFlush();
+        n = (r + 1 < imgRuns) ? imgRun[r+1].start : imgLen;
+        for (i = imgRun[r].start; i < n; i++)
+        {
+            codPtr = imgRun[r].addr + i - imgRun[r].start;
+            CodeOut(imgData[i]);
+        }
+    }
+    CodeEnd();
+
+    OnePassFree();
+
+    return TRUE;
+}
+
+
 void DoPass()
 {
     Str255      opcode;
@@ -5108,12 +6558,14 @@ void DoPass()
     MacroPtr    macro;
     SegPtr      seg;
 
-    fseek(source, 0, SEEK_SET); // rewind source file
+    sourcePos = 0;  // rewind source file
     sourceEnd = FALSE;
     lastLabl[0] = 0;
     subrLabl[0] = 0;
 
-    fprintf(stderr,"Pass %d\n",pass);
+    if (!asmxCtx && cl_NSrcFiles <= 1)
+        fprintf(stderr,"Pass %d\n",pass);
+    outPass = (pass == 2 || onePass);
 
     if (cl_ListP1)
         fprintf(listing,"Pass %d\n",pass);
@@ -5158,7 +6610,11 @@ void DoPass()
     i = ReadSourceLine(line, sizeof(line));
     while (i && !sourceEnd)
     {
+        if (onePass)
+            FixupLineStart();
         DoLine();
+        if (onePass)
+            FixupLineEnd();
         i = ReadSourceLine(line, sizeof(line));
     }
 
@@ -5172,7 +6628,7 @@ void DoPass()
     // any lines which have invalid syntax, etc., because whatever
     // is found after an END statement should esentially be ignored.
 
-    if (pass == 2 || cl_ListP1)
+    if (outPass || cl_ListP1)
     {
         while (i)
         {
@@ -5213,13 +6669,14 @@ void usage(void)
     stdversion();
     fprintf(stderr, "\n");
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "    %s [options] srcfile\n",progname);
+    fprintf(stderr, "    %s [options] srcfile...\n",progname);
     fprintf(stderr, "\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "    --                  end of options\n");
     fprintf(stderr, "    -e                  show errors to screen\n");
     fprintf(stderr, "    -w                  show warnings to screen\n");
 //  fprintf(stderr, "    -1                  output listing during first pass\n");
+    fprintf(stderr, "    -p                  assemble in one pass if forward references allow it\n");
     fprintf(stderr, "    -l [filename]       make a listing file, default is srcfile.lst\n");
     fprintf(stderr, "    -o [filename]       make an object file, default is srcfile.hex or srcfile.s9\n");
     fprintf(stderr, "    -d label[[:]=value] define a label, and assign an optional value\n");
@@ -5229,8 +6686,12 @@ void usage(void)
     fprintf(stderr, "    -s28                output object file in Motorola S9 format (24-bit address)\n");
     fprintf(stderr, "    -s37                output object file in Motorola S9 format (32-bit address)\n");
     fprintf(stderr, "    -b [base[-end]]     output object file as binary with optional base/end addresses\n");
+    fprintf(stderr, "                        (several base-end windows separated by commas go one after another)\n");
     fprintf(stderr, "    -t                  output object file in TRSDOS executable format (implies -C Z80)\n");
+    fprintf(stderr, "    -r                  output object file as RCA Studio II .st2 cartridge (implies -C 1802)\n");
+    fprintf(stderr, "                        (with -b, also writes the cartridge as binary to srcfile.bin)\n");
     fprintf(stderr, "    -c                  send object code to stdout\n");
+    fprintf(stderr, "    -j threads          number of threads for several srcfiles, default is one per CPU\n");
     fprintf(stderr, "    -C cputype          specify default CPU type (currently ");
     if (defCPU[0]) fprintf(stderr, "%s",defCPU);
               else fprintf(stderr, "no default");
@@ -5239,49 +6700,165 @@ void usage(void)
 }
 
 
-void getopts(int argc, char * const argv[])
+/*
+ *  DefineOpt defines the label from a -d option
+ */
+
+void DefineOpt(char *opt)
 {
-    int     ch;
     int     val;
     Str255  labl,word;
     bool    setSym;
     int     token;
     int     neg;
 
-    while ((ch = getopt(argc, argv, "ew19tb:cd:l:o:s:C:?")) != -1)
+    strncpy(line, opt, 255);
+    linePtr = line;
+    GetWord(labl);
+    val = 0;
+    setSym = FALSE;
+    token = GetWord(word);
+    if (token == ':')
     {
-        errFlag = FALSE;
-        switch (ch)
+        setSym = TRUE;
+        token = GetWord(word);
+    }
+    if (token == '=')
+    {
+        neg = 1;
+        if (GetWord(word) == '-')
         {
-            case 'e':
-                cl_Err = TRUE;
-                break;
+            neg = -1;
+            GetWord(word);
+        }
+        val = neg * EvalNum(word);
+        if (errFlag)
+        {
+            printf("Invalid number '%s' in -d option\n",word);
+            usage();
+        }
+    }
+    DefSym(labl,val,setSym,!setSym);
+}
 
-            case 'w':
-                cl_Warn = TRUE;
-                break;
 
-            case '1':
-                cl_ListP1 = TRUE;
-                break;
+/*
+ *  OutNames sets the default listing and object file names from the
+ *  source file name
+ */
 
-            case '9': // -9 option is deprecated
-                cl_S9type  = 9;
-                cl_ObjType = OBJ_S9;
-                break;
+void OutNames(void)
+{
+    Str255  word;
 
-            case 't':
-                cl_ObjType = OBJ_TRSDOS;
-                strcpy(defCPU, "Z80");
-                break;
+    if (cl_List && cl_ListName[0] == 0)
+    {
+        strncpy(cl_ListName, cl_SrcName, 255-4);
+        strcat (cl_ListName, ".lst");
+    }
 
-            case 's':
-                if (optarg[0] == '9' && optarg[1] == 0)
-                    cl_S9type = 9;
-                else if (optarg[0] == '1' && optarg[1] == '9' && optarg[2] == 0)
-                    cl_S9type = 19;
-                else if (optarg[0] == '2' && optarg[1] == '8' && optarg[2] == 0)
-                    cl_S9type = 28;
+    if (cl_Obj  && cl_ObjName [0] == 0)
+    {
+        switch(cl_ObjType)
+        {
+            case OBJ_S9:
+                strncpy(cl_ObjName, cl_SrcName, 255-3);
+                sprintf(word,".s%d",cl_S9type);
+                strcat (cl_ObjName, word);
+                break;
+
+            case OBJ_BIN:
+                strncpy(cl_ObjName, cl_SrcName, 255-4);
+                strcat (cl_ObjName, ".bin");
+                break;
+
+            case OBJ_TRSDOS:
+                strncpy(cl_ObjName, cl_SrcName, 255-4);
+                strcat (cl_ObjName, ".cmd");
+                break;
+
+            case OBJ_ST2:
+                strncpy(cl_ObjName, cl_SrcName, 255-4);
+                strcat (cl_ObjName, ".st2");
+                break;
+
+            default:
+            case OBJ_HEX:
+                strncpy(cl_ObjName, cl_SrcName, 255-4);
+                strcat (cl_ObjName, ".hex");
+                break;
+        }
+    }
+
+    if (cl_ST2Bin && cl_BinName[0] == 0)
+    {
+        strncpy(cl_BinName, cl_SrcName, 255-4);
+        strcat (cl_BinName, ".bin");
+    }
+}
+
+
+void getopts(int argc, char * const argv[])
+{
+    int     ch;
+    Str255  word;
+    int     token;
+    bool    st2Opt, binOpt, binWins;
+
+    st2Opt  = FALSE;
+    binOpt  = FALSE;
+    binWins = FALSE;
+
+    cl_Defs = malloc(argc * sizeof(char *));
+    cl_NDefs = 0;
+
+    while ((ch = getopt(argc, argv, "ew19ptrb:cd:j:l:o:s:C:?")) != -1)
+    {
+        errFlag = FALSE;
+        switch (ch)
+        {
+            case 'e':
+                cl_Err = TRUE;
+                break;
+
+            case 'w':
+                cl_Warn = TRUE;
+                break;
+
+            case '1':
+                cl_ListP1 = TRUE;
+                break;
+
+            case 'p':
+                cl_OnePass = TRUE;
+                break;
+
+            case '9': // -9 option is deprecated
+                cl_S9type  = 9;
+                cl_ObjType = OBJ_S9;
+                break;
+
+            case 't':
+                cl_ObjType = OBJ_TRSDOS;
+                strcpy(defCPU, "Z80");
+                break;
+
+            case 'r':
+                st2Opt = TRUE;
+                cl_ObjType = OBJ_ST2;
+                cl_Binbase[0] = ST2_BASE;
+                cl_Binend[0] = ST2_END;
+                cl_BinWins = 1;
+                strcpy(defCPU, "1802");
+                break;
+
+            case 's':
+                if (optarg[0] == '9' && optarg[1] == 0)
+                    cl_S9type = 9;
+                else if (optarg[0] == '1' && optarg[1] == '9' && optarg[2] == 0)
+                    cl_S9type = 19;
+                else if (optarg[0] == '2' && optarg[1] == '8' && optarg[2] == 0)
+                    cl_S9type = 28;
                 else if (optarg[0] == '3' && optarg[1] == '7' && optarg[2] == 0)
                     cl_S9type = 37;
                 else usage();
@@ -5289,9 +6866,11 @@ void getopts(int argc, char * const argv[])
                 break;
 
             case 'b':
+                binOpt = TRUE;
                 cl_ObjType = OBJ_BIN;
-                cl_Binbase = 0;
-                cl_Binend = 0xFFFFFFFF;
+                cl_Binbase[0] = 0;
+                cl_Binend[0] = 0xFFFFFFFF;
+                cl_BinWins = 1;
 
                 if (optarg[0] =='-')
                 {   // -b with no parameter
@@ -5302,30 +6881,50 @@ void getopts(int argc, char * const argv[])
                 {   // - b with parameter
                     strncpy(line, optarg, 255);
                     linePtr = line;
+                    cl_BinWins = 0;
+                    binWins = TRUE;
 
-                    // get start parameter
-                    if (GetWord(word) != -1) usage();
-                    cl_Binbase = EvalNum(word);
-                    if (errFlag)
+                    do
                     {
-                        printf("Invalid number '%s' in -b option\n",word);
-                        usage();
-                    }
+                        if (cl_BinWins == MAX_BINWIN)
+                        {
+                            printf("Too many address windows in -b option\n");
+                            usage();
+                        }
 
-                    // get optional end parameter
-                    token = GetWord(word);
-                    if (token)
-                    {
-                        if (token != '-') usage();
+                        // an earlier window needs an end address
+                        if (cl_BinWins > 0 && cl_Binend[cl_BinWins-1] == 0xFFFFFFFF)
+                            usage();
 
+                        // get start parameter
                         if (GetWord(word) != -1) usage();
-                        cl_Binend = EvalNum(word);
+                        cl_Binbase[cl_BinWins] = EvalNum(word);
+                        cl_Binend[cl_BinWins] = 0xFFFFFFFF;
                         if (errFlag)
                         {
                             printf("Invalid number '%s' in -b option\n",word);
                             usage();
                         }
-                    }
+
+                        // get optional end parameter
+                        token = GetWord(word);
+                        if (token == '-')
+                        {
+                            if (GetWord(word) != -1) usage();
+                            cl_Binend[cl_BinWins] = EvalNum(word);
+                            if (errFlag)
+                            {
+                                printf("Invalid number '%s' in -b option\n",word);
+                                usage();
+                            }
+                            if (cl_Binend[cl_BinWins] < cl_Binbase[cl_BinWins]) usage();
+                            token = GetWord(word);
+                        }
+                        cl_BinWins++;
+
+                        // get optional next window
+                        if (token && token != ',') usage();
+                    } while (token);
                 }
                 break;
 
@@ -5339,33 +6938,14 @@ void getopts(int argc, char * const argv[])
                 break;
 
             case 'd':
-                strncpy(line, optarg, 255);
-                linePtr = line;
-                GetWord(labl);
-                val = 0;
-                setSym = FALSE;
-                token = GetWord(word);
-                if (token == ':')
-                {
-                    setSym = TRUE;
-                    token = GetWord(word);
-                }
-                if (token == '=')
-                {
-                    neg = 1;
-                    if (GetWord(word) == '-')
-                    {
-                        neg = -1;
-                        GetWord(word);
-                    }
-                    val = neg * EvalNum(word);
-                    if (errFlag)
-                    {
-                        printf("Invalid number '%s' in -d option\n",word);
-                        usage();
-                    }
-                }
-                DefSym(labl,val,setSym,!setSym);
+                DefineOpt(optarg);
+                cl_Defs[cl_NDefs++] = optarg;
+                break;
+
+            case 'j':
+                cl_Jobs = atoi(optarg);
+                if (cl_Jobs < 1)
+                    usage();
                 break;
 
             case 'l':
@@ -5412,9 +6992,24 @@ void getopts(int argc, char * const argv[])
     argc -= optind;
     argv += optind;
 
-    if (cl_Stdout && cl_ObjType == OBJ_BIN)
+    // -r with -b writes the cartridge image as a binary file as well
+    if (st2Opt && binOpt)
     {
-        fprintf(stderr,"%s: Conflicting options: -b can not be used with -c\n",progname);
+        if (binWins)
+        {
+            fprintf(stderr,"%s: Conflicting options: -b can not have addresses when used with -r\n",progname);
+            usage();
+        }
+        cl_ObjType = OBJ_ST2;
+        cl_Binbase[0] = ST2_BASE;
+        cl_Binend[0] = ST2_END;
+        cl_BinWins = 1;
+        cl_ST2Bin = TRUE;
+    }
+
+    if (cl_Stdout && (cl_ObjType == OBJ_BIN || cl_ObjType == OBJ_ST2))
+    {
+        fprintf(stderr,"%s: Conflicting options: -b or -r can not be used with -c\n",progname);
         usage();
     }
 
@@ -5427,62 +7022,45 @@ void getopts(int argc, char * const argv[])
     // now argc is the number of remaining arguments
     // and argv[0] is the first remaining argument
 
-    if (argc != 1)
+    if (argc < 1)
         usage();
 
-    strncpy(cl_SrcName, argv[0], 255);
+    cl_SrcFiles  = argv;
+    cl_NSrcFiles = argc;
+    strcpy(cl_DefCPU, defCPU);
 
-    // note: this won't work if there's a single-char filename in the current directory!
-    if (cl_SrcName[0] == '?' && cl_SrcName[1] == 0)
-        usage();
-
-    if (cl_List && cl_ListName[0] == 0)
+    if (argc > 1 && (cl_Stdout || cl_ListName[0] || cl_ObjName[0]))
     {
-        strncpy(cl_ListName, cl_SrcName, 255-4);
-        strcat (cl_ListName, ".lst");
+        fprintf(stderr,"%s: Conflicting options: -c or a -l or -o filename can not be used with several source files\n",progname);
+        usage();
     }
 
-    if (cl_Obj  && cl_ObjName [0] == 0)
-    {
-        switch(cl_ObjType)
-        {
-            case OBJ_S9:
-                strncpy(cl_ObjName, cl_SrcName, 255-3);
-                sprintf(word,".s%d",cl_S9type);
-                strcat (cl_ObjName, word);
-                break;
-
-            case OBJ_BIN:
-                strncpy(cl_ObjName, cl_SrcName, 255-4);
-                strcat (cl_ObjName, ".bin");
-                break;
+    strncpy(cl_SrcName, argv[0], 255);
 
-            case OBJ_TRSDOS:
-                strncpy(cl_ObjName, cl_SrcName, 255-4);
-                strcat (cl_ObjName, ".cmd");
-                break;
+    // note: this won't work if there's a single-char filename in the current directory!
+    if (cl_SrcName[0] == '?' && cl_SrcName[1] == 0)
+        usage();
 
-            default:
-            case OBJ_HEX:
-                strncpy(cl_ObjName, cl_SrcName, 255-4);
-                strcat (cl_ObjName, ".hex");
-                break;
-        }
-    }
+    OutNames();
 }
 
 
-int main(int argc, char * const argv[])
+/*
+ *  ResetState sets up the assembler state for a new assembly
+ */
+
+void ResetState(void)
 {
     int i;
 
-    // initialize and get parms
-
-    progname   = argv[0];
     pass       = 0;
     symTab     = NULL;
     xferAddr   = 0;
     xferFound  = FALSE;
+    strcpy(st2Author, "??");
+    strcpy(st2Dumper, "??");
+    st2Cat[0]   = 0;
+    st2Title[0] = 0;
 
     macroTab   = NULL;
     macPtr[0]  = NULL;
@@ -5491,15 +7069,6 @@ int main(int argc, char * const argv[])
     nullSeg    = AddSeg("");
     curSeg     = nullSeg;
 
-    cl_Err     = FALSE;
-    cl_Warn    = FALSE;
-    cl_List    = FALSE;
-    cl_Obj     = FALSE;
-    cl_ObjType = OBJ_HEX;
-    cl_ListP1  = FALSE;
-
-    asmTab     = NULL;
-    cpuTab     = NULL;
     defCPU[0]  = 0;
 
     nInclude  = -1;
@@ -5509,19 +7078,260 @@ int main(int argc, char * const argv[])
     cl_SrcName [0] = 0;     source  = NULL;
     cl_ListName[0] = 0;     listing = NULL;
     cl_ObjName [0] = 0;     object  = NULL;
+    cl_BinName [0] = 0;
     incbin = NULL;
+}
+
+
+/*
+ *  FreeState frees everything allocated by an assembly
+ */
+
+void FreeState(void)
+{
+    char            *blk;
+    MacroPtr        macro;
+    MacroLinePtr    m;
+    MacroParmPtr    parm;
+    SegPtr          seg;
+    SrcFilePtr      src;
+
+    while (symBlocks)
+    {
+        blk = symBlocks;
+        symBlocks = *(char **) blk;
+        free(blk);
+    }
+    free(symHash);
+    symTab       = NULL;
+    symHash      = NULL;
+    symHashSize  = 0;
+    symCount     = 0;
+    symArena     = NULL;
+    symArenaLeft = 0;
+
+    while (macroTab)
+    {
+        macro = macroTab;
+        macroTab = macro -> next;
+        while (macro -> text)
+        {
+            m = macro -> text;
+            macro -> text = m -> next;
+            free(m -> tok);
+            free(m);
+        }
+        while (macro -> parms)
+        {
+            parm = macro -> parms;
+            macro -> parms = parm -> next;
+            free(parm);
+        }
+        free(macro);
+    }
+    free(macroHash);
+    macroHash     = NULL;
+    macroHashSize = 0;
+    macroCount    = 0;
+
+    while (segTab)
+    {
+        seg = segTab;
+        segTab = seg -> next;
+        free(seg);
+    }
+
+    while (srcFileTab)
+    {
+        src = srcFileTab;
+        srcFileTab = src -> next;
+        free(src -> text);
+        free(src -> lines);
+        free(src);
+    }
+}
+
+
+// --------------------------------------------------------------
+// library interface (see asmxlib.h)
+
+
+/*
+ *  LibInclude gets an INCLUDE or INCBIN file from the library caller
+ */
+
+const char *LibInclude(char *fname, long *len)
+{
+    if (asmxCtx -> include == NULL)
+        return NULL;
+
+    return asmxCtx -> include(asmxCtx -> user, fname, len);
+}
+
+
+/*
+ *  LibCodeOut puts a byte of object code into the library caller's image
+ */
 
+void LibCodeOut(int byte)
+{
+    asmx_context *ctx = asmxCtx;
+
+    if (codPtr < ctx -> codeLow)
+        ctx -> codeLow = codPtr;
+    if (codPtr >= ctx -> codeHigh)
+        ctx -> codeHigh = codPtr + 1;
+
+    if (codPtr >= ctx -> imageBase && codPtr - ctx -> imageBase < ctx -> imageSize)
+        ctx -> image[codPtr - ctx -> imageBase] = byte;
+}
+
+
+/*
+ *  LibInit sets up the assemblers and CPU tables, which are shared by
+ *  all threads. asmx_init makes sure it is only run once.
+ */
+
+#ifdef _WIN32
+INIT_ONCE       libInitOnce = INIT_ONCE_STATIC_INIT;
+
+BOOL CALLBACK LibInit(PINIT_ONCE once, PVOID parm, PVOID *ctx)
+#else
+pthread_once_t  libInitOnce = PTHREAD_ONCE_INIT;
+
+void LibInit(void)
+#endif
+{
+    if (progname == NULL)
+        progname = "asmx";
     AsmInit();
 
-    getopts(argc, argv);
+#ifdef _WIN32
+    return TRUE;
+#endif
+}
+
+
+/*
+ *  asmx_init sets up the assemblers and CPU tables the first time it is
+ *  called, from whichever thread calls it first
+ */
+
+void asmx_init(void)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&libInitOnce, LibInit, NULL, NULL);
+#else
+    pthread_once(&libInitOnce, LibInit);
+#endif
+}
+
+
+/*
+ *  asmx_assemble assembles ctx -> source in two passes, the same as the
+ *  command line does, but with no files: object code goes into the
+ *  caller's image and INCLUDE and INCBIN files come from ctx -> include
+ */
+
+int asmx_assemble(asmx_context *ctx)
+{
+    Str255      word;
+    char        *text;
+    size_t      len;
+    SymPtr      p;
+
+    asmx_init();
+    ResetState();
+
+    if (ctx -> cpu)
+    {
+        strncpy(word, ctx -> cpu, 255);
+        word[255] = 0;
+        Uprcase(word);
+        if (!FindCPU(word))
+        {
+            FreeState();
+            return -1;
+        }
+        strcpy(defCPU, word);
+    }
+
+    asmxCtx = ctx;
+    ctx -> codeLow  = ~0UL;
+    ctx -> codeHigh = 0;
+    strncpy(cl_SrcName, ctx -> name ? ctx -> name : "", 255);
+
+    len  = strlen(ctx -> source);
+    text = malloc(len + 1);
+    if (text)
+    {
+        memcpy(text, ctx -> source, len);
+        source = SplitSrcFile(cl_SrcName, text, len);
+        if (source)
+        {
+            source -> next = srcFileTab;
+            srcFileTab = source;
+        }
+    }
+    if (source == NULL)
+    {
+        Error("Out of memory for source");
+        ctx -> errors = 1;
+    }
+    else
+    {
+        CodeInit();
+
+        pass = 1;
+        DoPass();
+        pass = 2;
+        DoPass();
+
+        if (ctx -> symbol)
+            for (p = symTab; p; p = p -> next)
+                if (p -> defined)
+                    ctx -> symbol(ctx -> user, p -> name, p -> value);
+
+        ctx -> errors = errCount;
+    }
+
+    if (ctx -> codeLow > ctx -> codeHigh)
+        ctx -> codeLow = ctx -> codeHigh;   // no object code
+
+    FreeState();
+    asmxCtx = NULL;
+
+    return ctx -> errors;
+}
+
+
+#ifndef ASMX_LIBRARY   // the library has no main
+
+int     nextSrcFile;        // next source file for a batch thread
+int     batchErrors;        // number of batch source files with errors
+
+#ifdef _WIN32
+typedef HANDLE      BatchThreadId;
+#define BATCH_THREAD    unsigned __stdcall
+#else
+typedef pthread_t   BatchThreadId;
+#define BATCH_THREAD    void *
+#endif
+
+
+/*
+ *  AssembleFile assembles cl_SrcName, returns 1 if there were errors
+ */
 
+int AssembleFile(void)
+{
     // open files
 
-    source = fopen(cl_SrcName, "r");
+    source = LoadSrcFile(cl_SrcName);
     if (source == NULL)
     {
         fprintf(stderr,"Unable to open source input file '%s'!\n",cl_SrcName);
-        exit(1);
+        return 1;
     }
 
     if (cl_List)
@@ -5530,9 +7340,7 @@ int main(int argc, char * const argv[])
         if (listing == NULL)
         {
             fprintf(stderr,"Unable to create listing output file '%s'!\n",cl_ListName);
-            if (source)
-                fclose(source);
-            exit(1);
+            return 1;
         }
     }
 
@@ -5546,24 +7354,32 @@ int main(int argc, char * const argv[])
         if (object == NULL)
         {
             fprintf(stderr,"Unable to create object output file '%s'!\n",cl_ObjName);
-            if (source)
-                fclose(source);
             if (listing)
                 fclose(listing);
-            exit(1);
+            return 1;
         }
     }
 
     CodeInit();
 
     pass = 1;
+    onePass = cl_OnePass && !cl_ListP1;
     DoPass();
 
-    pass = 2;
-    DoPass();
+    if (!OnePassFinish())
+    {
+        pass = 2;
+        DoPass();
+    }
 
     if (cl_List)    fprintf(listing, "\n%.5d Total Error(s)\n\n", errCount);
-    if (cl_Err)     fprintf(stderr,  "\n%.5d Total Error(s)\n\n", errCount);
+    if (cl_Err)
+    {
+        if (cl_NSrcFiles > 1)
+            fprintf(stderr, "\n%s: %.5d Total Error(s)\n\n", cl_SrcName, errCount);
+        else
+            fprintf(stderr, "\n%.5d Total Error(s)\n\n", errCount);
+    }
 
     if (symtabFlag)
     {
@@ -5572,12 +7388,163 @@ int main(int argc, char * const argv[])
     }
 //  DumpMacroTab();
 
-    if (source)
-        fclose(source);
     if (listing)
         fclose(listing);
     if (object && object != stdout)
         fclose(object);
 
     return (errCount != 0);
-}
\ No newline at end of file
+}
+
+
+/*
+ *  BatchThread assembles source files from the command line until there
+ *  are none left, each with a fresh assembler state
+ */
+
+BATCH_THREAD BatchThread(void *arg)
+{
+    int     i,n;
+
+    for (;;)
+    {
+        LockBatch();
+        n = nextSrcFile++;
+        UnlockBatch();
+        if (n >= cl_NSrcFiles)
+            break;
+
+        ResetState();
+        strcpy(defCPU, cl_DefCPU);
+        for (i = 0; i < cl_NDefs; i++)
+            DefineOpt(cl_Defs[i]);
+        strncpy(cl_SrcName, cl_SrcFiles[n], 255);
+        OutNames();
+
+        i = AssembleFile();
+        FreeState();
+
+        LockBatch();
+        batchErrors += i;
+        UnlockBatch();
+    }
+
+    return 0;
+}
+
+
+/*
+ *  StartThread and JoinThread use Windows or POSIX threads
+ */
+
+bool StartThread(BatchThreadId *t)
+{
+#ifdef _WIN32
+    *t = (HANDLE) _beginthreadex(NULL, 0, BatchThread, NULL, 0, NULL);
+    return (*t != 0);
+#else
+    return (pthread_create(t, NULL, BatchThread, NULL) == 0);
+#endif
+}
+
+
+void JoinThread(BatchThreadId t)
+{
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+
+/*
+ *  CPUCount returns the number of CPUs, the default number of batch threads
+ */
+
+int CPUCount(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    return 1;
+#endif
+}
+
+
+/*
+ *  AssembleBatch assembles several source files at once, one thread per
+ *  CPU unless -j says otherwise. Source and include files go in
+ *  srcFileCache, so one that several sources include by the same path is
+ *  only read once.
+ */
+
+int AssembleBatch(void)
+{
+    BatchThreadId threads[MAX_JOBS];
+    int         i,n;
+
+    n = cl_Jobs;
+    if (n == 0)
+        n = CPUCount();
+    if (n > cl_NSrcFiles)
+        n = cl_NSrcFiles;
+    if (n > MAX_JOBS)
+        n = MAX_JOBS;
+    if (n < 1)
+        n = 1;
+
+    // the -d labels from getopts were only defined to check them
+    FreeState();
+
+    // this thread is one of the workers
+    for (i = 1; i < n; i++)
+        if (!StartThread(&threads[i]))
+            break;
+    BatchThread(NULL);
+    while (--i > 0)
+        JoinThread(threads[i]);
+
+    return (batchErrors != 0);
+}
+
+
+int main(int argc, char * const argv[])
+{
+    // initialize and get parms
+
+    progname   = argv[0];
+    asmTab     = NULL;
+    cpuTab     = NULL;
+
+    cl_Err     = FALSE;
+    cl_Warn    = FALSE;
+    cl_List    = FALSE;
+    cl_Obj     = FALSE;
+    cl_ObjType = OBJ_HEX;
+    cl_ListP1  = FALSE;
+    cl_OnePass = FALSE;
+    cl_ST2Bin  = FALSE;
+
+#ifdef _WIN32
+    InitializeCriticalSection(&batchLock);
+#endif
+
+    ResetState();
+    AsmInit();
+
+    getopts(argc, argv);
+
+    if (cl_NSrcFiles > 1)
+        return AssembleBatch();
+
+    return AssembleFile();
+}
+
+#endif // ASMX_LIBRARY
@@ -25,6 +25,14 @@ typedef unsigned char  bool;    // define a bool type
 enum { FALSE = 0, TRUE = 1 };
 typedef char Str255[256];       // generic string type
 
+// assembler state is kept per thread, so that several threads can
+// each run an assembly at the same time (see asmxlib.h)
+#ifdef _MSC_VER
+#define THREAD __declspec(thread)
+#else
+#define THREAD __thread
+#endif
+
 #define maxOpcdLen  11          // max opcode length (for building opcode table)
 typedef char OpcdStr[maxOpcdLen+1];
 struct OpcdRec
@@ -139,21 +147,22 @@ char * ListByte(char *p, u_char b);
 //char * ListLoc(u_long addr);
 
 // various internal variables used by the assemblers
-extern  bool            errFlag;            // TRUE if error occurred this line
-extern  int             pass;               // Current assembler pass
-extern  char           *linePtr;            // pointer into current line
-extern  int             instrLen;           // Current instruction length (negative to display as long DB)
-extern  Str255          line;               // Current line from input file
-extern  char           *linePtr;            // pointer into current line
-extern  u_long          locPtr;             // Current program address
-extern  int             instrLen;           // Current instruction length (negative to display as long DB)
-extern  u_char          bytStr[MAX_BYTSTR]; // Current instruction / buffer for long DB statements
-extern  bool            showAddr;           // TRUE to show LocPtr on listing
-extern  int             endian;             // 0 = little endian, 1 = big endian, -1 = undefined endian
-extern  bool            evalKnown;          // TRUE if all operands in Eval were "known"
-extern  int             curCPU;             // current CPU index for current assembler
-extern  Str255          listLine;           // Current listing line
-extern  int             hexSpaces;          // flags for spaces in hex output for instructions
-extern  int             listWid;            // listing width: LIST_16, LIST_24
+extern  THREAD bool     errFlag;            // TRUE if error occurred this line
+extern  THREAD int      pass;               // Current assembler pass
+extern  THREAD bool     outPass;            // TRUE if this pass writes the listing and object code
+extern  THREAD char    *linePtr;            // pointer into current line
+extern  THREAD int      instrLen;           // Current instruction length (negative to display as long DB)
+extern  THREAD Str255   line;               // Current line from input file
+extern  THREAD char    *linePtr;            // pointer into current line
+extern  THREAD u_long   locPtr;             // Current program address
+extern  THREAD int      instrLen;           // Current instruction length (negative to display as long DB)
+extern  THREAD u_char   bytStr[MAX_BYTSTR]; // Current instruction / buffer for long DB statements
+extern  THREAD bool     showAddr;           // TRUE to show LocPtr on listing
+extern  THREAD int      endian;             // 0 = little endian, 1 = big endian, -1 = undefined endian
+extern  THREAD bool     evalKnown;          // TRUE if all operands in Eval were "known"
+extern  THREAD int      curCPU;             // current CPU index for current assembler
+extern  THREAD Str255   listLine;           // Current listing line
+extern  THREAD int      hexSpaces;          // flags for spaces in hex output for instructions
+extern  THREAD int      listWid;            // listing width: LIST_16, LIST_24
 
 #endif // _ASMX_H_
\ No newline at end of file
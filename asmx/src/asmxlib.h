@@ -0,0 +1,47 @@
+// asmxlib.h - assembling from memory with asmx
+
+#ifndef _ASMXLIB_H_
+#define _ASMXLIB_H_
+
+// An asmx_context describes one assembly: the source text, where INCLUDE
+// and INCBIN files come from, and where the object code, symbols and
+// messages go.  Nothing is read from or written to files.
+//
+// The assembler's working state is not in the asmx_context: it is in
+// thread-local globals inside asmx.  So a thread can only run one
+// assembly at a time, though several threads can each run their own at
+// once.  asmx_assemble() must not be called from inside one of its own
+// callbacks, as the inner assembly would overwrite the outer one's state.
+//
+// asmx_init() can be called from any thread, any number of times; the
+// tables are set up only the first time.  asmx_assemble() calls it too.
+// On POSIX systems, link with -lpthread.
+
+typedef struct asmx_context
+{
+    // input
+    const char      *name;          // name of the source, for messages
+    const char      *source;        // source text
+    const char      *cpu;           // default CPU type, or NULL for none
+    const char      *(*include) (void *user, const char *name, long *len);
+                                    // returns the contents and length of an INCLUDE or
+                                    // INCBIN file, or NULL if there is no such file
+    void            *user;          // passed to the callbacks
+
+    // output
+    unsigned char   *image;         // object code image, bytes outside it are dropped
+    unsigned long   imageBase;      // address of image[0]
+    unsigned long   imageSize;      // size of image
+    unsigned long   codeLow;        // lowest address of object code
+    unsigned long   codeHigh;       // address after the highest byte of object code
+    void            (*symbol) (void *user, const char *name, unsigned long value);
+                                    // called for each defined symbol, or NULL
+    void            (*message) (void *user, const char *text);
+                                    // called with error and warning text, or NULL
+    int             errors;         // number of errors
+} asmx_context;
+
+void asmx_init(void);                   // sets up the CPU tables, once
+int  asmx_assemble(asmx_context *ctx);  // returns the number of errors, -1 for an unknown CPU
+
+#endif // _ASMXLIB_H_
@@ -0,0 +1,70 @@
+#
+#	Times assembling the Studio II games and prints source lines per second.
+#
+#	python gamebench.py [asmx] [other asmx]
+#
+#	Each run assembles every game in GAMES once, with a listing as build.bat does, then the same
+#	number of empty sources ; the difference is the assembly time without the cost of starting asmx.
+#	Times are the user+system CPU time of the asmx processes. The median of RUNS runs is used.
+#	Given a second asmx the two are run alternately and the median of the paired differences
+#	is printed as well, which is steadier than comparing two separate benchmarks.
+#
+import glob,os,resource,subprocess,sys
+
+GAMES = os.environ.get("GAMES","../../Games")								# Games directory, GAMES=... to use another
+RUNS = int(os.environ.get("RUNS","101"))									# Runs, RUNS=... to change it
+
+def median(values):
+	values = sorted(values)
+	return values[len(values) // 2]
+
+class GameBench:
+	def __init__(self,asmx):
+		self.asmx = os.path.abspath(asmx)
+		self.games = sorted(glob.glob(os.path.join(os.path.abspath(GAMES),"*","*.asm")))
+		self.output = os.path.abspath("gamebench.out")
+		open(self.output+".asm","w").close()								# The empty source
+		self.times = []
+	def lines(self):														# Source lines, each include once per game
+		total = 0
+		for src in self.games:
+			for name in [src] + glob.glob(os.path.join(os.path.dirname(src),"*.inc")):
+				total = total + len(open(name).readlines())
+		return total
+	def assemble(self,sources):												# CPU seconds to assemble the sources
+		null = open(os.devnull,"w")
+		start = resource.getrusage(resource.RUSAGE_CHILDREN)
+		for src in sources:
+			subprocess.call([self.asmx,"-l",self.output+".lst","-o",self.output+".hex","-e","-w","-C","1802",
+								os.path.basename(src)],cwd=os.path.dirname(src),stdout=null,stderr=null)
+		end = resource.getrusage(resource.RUSAGE_CHILDREN)
+		return (end.ru_utime+end.ru_stime) - (start.ru_utime+start.ru_stime)
+	def run(self):															# One run, kept in times
+		empty = [self.output+".asm"] * len(self.games)
+		self.times.append(self.assemble(self.games) - self.assemble(empty))
+		return self.times[-1]
+	def report(self):
+		ms = median(self.times) * 1000
+		print("%s: %d lines, %d runs, median %.2f ms (%.2f to %.2f ms), %d lines/second" %
+					(self.asmx,self.lines(),len(self.times),ms,min(self.times)*1000,max(self.times)*1000,self.lines()*1000/ms))
+	def tidy(self):
+		for ext in [".asm",".lst",".hex"]:
+			if os.path.exists(self.output+ext):
+				os.remove(self.output+ext)
+
+benches = [GameBench(asmx) for asmx in (sys.argv[1:3] or ["../src/asmx"])]
+for bench in benches:																# Warm up the file cache
+	bench.run()
+	bench.times = []
+differences = []
+for n in range(0,RUNS):
+	order = benches if n % 2 == 0 else benches[::-1]							# Alternate which goes first
+	times = dict((bench,bench.run()) for bench in order)
+	if len(benches) == 2:
+		differences.append(times[benches[0]] - times[benches[1]])
+for bench in benches:
+	bench.report()
+if len(benches) == 2:
+	print("median of paired differences (first - second) %.2f ms, second faster in %d of %d runs" %
+				(median(differences)*1000,len([d for d in differences if d > 0]),RUNS))
+benches[0].tidy()
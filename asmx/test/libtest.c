@@ -0,0 +1,209 @@
+// libtest.c - checks libasmx against the games' committed binaries
+//
+// usage: libtest <Games directory>
+//
+// Several threads each assemble every game through asmx_assemble(), at
+// the same time and in different orders, and check the memory image
+// against the game's .asm.bin file made by the command line asmx.
+// Returns 0 if every assembly matched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "asmxlib.h"
+
+#define THREADS     4           // number of threads assembling at once
+#define ROUNDS      3           // times each thread assembles each game
+#define BASE        0x400       // the games' image is $400-$FFF
+#define SIZE        0xC00
+#define MAX_FILES   8           // INCLUDE and INCBIN files in one assembly
+
+const char *games[] =
+{
+    "Asteroids/asteroids", "Berzerk/berzerk", "Combat/combat", "Hockey/hockey",
+    "Invaders/invaders", "Kaboom/kaboom", "Pacman/pacman", "Scramble/scramble"
+};
+#define NGAMES  (sizeof games / sizeof games[0])
+
+const char      *gamesDir;      // the Games directory
+int             failures;       // assemblies that didn't match
+pthread_mutex_t failLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct
+{
+    char            dir[256];   // directory of the game's source
+    char            *files[MAX_FILES];  // INCLUDE and INCBIN files read for it
+    int             nfiles;
+} Job;
+
+
+/*
+ *  ReadFile reads a whole file with a null after it, returns NULL if it
+ *  can't be read
+ */
+
+char *ReadFile(const char *fname, long *len)
+{
+    FILE    *f;
+    char    *text;
+
+    f = fopen(fname, "rb");
+    if (f == NULL)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    text = malloc(*len + 1);
+    if (text && fread(text, 1, *len, f) != (size_t) *len)
+    {
+        free(text);
+        text = NULL;
+    }
+    if (text)
+        text[*len] = 0;
+    fclose(f);
+
+    return text;
+}
+
+
+/*
+ *  Include is the INCLUDE and INCBIN callback, it reads the file from
+ *  the game's directory and keeps it until the assembly is done
+ */
+
+const char *Include(void *user, const char *name, long *len)
+{
+    Job     *job = user;
+    char    path[512];
+    char    *text;
+
+    if (job -> nfiles == MAX_FILES)
+        return NULL;
+
+    snprintf(path, sizeof path, "%s/%s", job -> dir, name);
+    text = ReadFile(path, len);
+    if (text)
+        job -> files[job -> nfiles++] = text;
+
+    return text;
+}
+
+
+void Message(void *user, const char *text)
+{
+    fputs(text, stderr);
+}
+
+
+void Fail(const char *game, const char *why)
+{
+    pthread_mutex_lock(&failLock);
+    fprintf(stderr, "%s: %s\n", game, why);
+    failures++;
+    pthread_mutex_unlock(&failLock);
+}
+
+
+/*
+ *  Check assembles one game and compares it with its .asm.bin file
+ */
+
+void Check(const char *game)
+{
+    Job             job;
+    asmx_context    ctx;
+    unsigned char   image[SIZE];
+    char            path[512];
+    char            *source, *bin, *p;
+    long            len, binLen;
+    int             i;
+
+    snprintf(path, sizeof path, "%s/%s.asm", gamesDir, game);
+    source = ReadFile(path, &len);
+    snprintf(path, sizeof path, "%s/%s.asm.bin", gamesDir, game);
+    bin = ReadFile(path, &binLen);
+    if (source == NULL || bin == NULL)
+    {
+        Fail(game, "can't read the source or binary");
+        free(source);
+        free(bin);
+        return;
+    }
+
+    // INCLUDE files are in the same directory as the source
+    snprintf(job.dir, sizeof job.dir, "%s/%s", gamesDir, game);
+    p = strrchr(job.dir, '/');
+    *p = 0;
+    job.nfiles = 0;
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.name      = game;
+    ctx.source    = source;
+    ctx.cpu       = "1802";
+    ctx.include   = Include;
+    ctx.user      = &job;
+    ctx.image     = image;
+    ctx.imageBase = BASE;
+    ctx.imageSize = SIZE;
+    ctx.message   = Message;
+    memset(image, 0xFF, sizeof image);
+
+    if (asmx_assemble(&ctx) != 0)
+        Fail(game, "assembly errors");
+    else if (ctx.codeHigh != BASE + binLen || binLen > SIZE)
+        Fail(game, "code does not end where the binary does");
+    else if (memcmp(image, bin, binLen) != 0)
+        Fail(game, "image differs from the binary");
+
+    for (i = 0; i < job.nfiles; i++)
+        free(job.files[i]);
+    free(source);
+    free(bin);
+}
+
+
+/*
+ *  Thread assembles every game ROUNDS times, starting at a different
+ *  game in each thread so different games are assembled at once
+ */
+
+void *Thread(void *arg)
+{
+    int     first = (int) (long) arg;
+    int     i;
+
+    for (i = 0; i < ROUNDS * NGAMES; i++)
+        Check(games[(first + i) % NGAMES]);
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    pthread_t   threads[THREADS];
+    int         i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: libtest <Games directory>\n");
+        return 2;
+    }
+    gamesDir = argv[1];
+
+    for (i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, Thread, (void *) (long) (i * 2)) != 0)
+        {
+            fprintf(stderr, "libtest: can't start a thread\n");
+            return 2;
+        }
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    return failures != 0;
+}
@@ -0,0 +1,69 @@
+;	macro expansion, assembled as 1802
+;	most lines are db/dw so the expanded text shows up in the object code
+
+	opt	macro		; list the expansions
+	org	0
+
+v	equ	5
+v1	equ	6
+w1	equ	8
+r7	equ	7
+r71	equ	9
+
+;	named parameters, in code, strings and expressions
+
+ldreg	macro	reg, val
+	ldi	val >> 8	; high of val
+	phi	reg
+	ldi	val & 255
+	plo	reg
+	db	"reg val", 'val'
+	endm
+
+	ldreg	7, 0ABCDh
+	ldreg	r7, label
+
+;	## concatenation, \0 count, \1-\9 by number, \? unique label
+
+cat	macro	a, b
+a ## b	db	\0, \1 , \2 + 0
+lbl\?	dw	a##b, lbl\?
+	db	a ## 1 - 1, 2 ## b
+	endm
+
+	cat	v, 7
+	cat	w,		; empty parameter
+
+;	a macro calling macros
+
+nest	macro	p
+	ldreg	p, 1234h
+	cat	p, 9
+	endm
+
+	nest	r7
+
+;	quoted parameters keep their commas and semicolons
+
+quote	macro	s, c
+	db	s, c, \0
+	endm
+
+	quote	"a,b", 'x'
+	quote	"x;y", ';'	; comment
+
+label:	db	0
+
+;	'$' is a symbol character for the Z80 but a hex prefix for the 1802,
+;	so the same macro line splits differently under each CPU
+
+	cpu	z80
+mm	macro	$a, b
+	db	$a, b
+	endm
+
+	mm	1, 2
+	cpu	1802
+	mm	3, 4
+
+	end
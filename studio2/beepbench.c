@@ -0,0 +1,111 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       BeepBench.C
+//      Purpose:    Beeper tone accuracy and CPU cost benchmark
+//      Author:     Paul Robson
+//      Date:       16th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "general.h"
+#include "beeper.h"
+
+#define FREQUENCY   (625)                                                           // Same as the emulator beeper
+#define SECONDS     (60)                                                            // Length of the timing run
+#define CALLBACK    (2048)                                                          // Samples per audio callback
+
+typedef void (*RENDERER)(INT16 *stream,int length);
+
+//*******************************************************************************************************
+//                          Energy at a given frequency (Goertzel)
+//*******************************************************************************************************
+
+static double BENCH_Energy(INT16 *data,int length,int rate,double frequency)
+{
+    int i;
+    double c = 2.0 * cos(2.0 * M_PI * frequency / rate),s0,s1 = 0.0,s2 = 0.0;
+    for (i = 0;i < length;i++)
+    {
+        s0 = data[i] + c * s1 - s2;
+        s2 = s1;s1 = s0;
+    }
+    return (s1 * s1 + s2 * s2 - c * s1 * s2) * 2.0 / ((double)length * length);    // Power of that component
+}
+
+//*******************************************************************************************************
+//      Measure one second of tone : frequency from zero crossings, energy not on a harmonic is alias
+//*******************************************************************************************************
+
+static void BENCH_Accuracy(char *name,RENDERER render,int rate)
+{
+    int i,crossings = 0;
+    double first = -1.0,last = 0.0,total = 0.0,harmonic = 0.0,f;
+    INT16 *data = (INT16 *)malloc(sizeof(INT16) * rate * 2);
+    BEEP_Initialise(rate,FREQUENCY);
+    BEEP_SetGate(TRUE);
+    render(data,rate * 2);                                                          // Skip the first second
+    for (i = 1;i < rate;i++)                                                        // Rising zero crossings
+    {
+        INT16 a = data[rate+i-1],b = data[rate+i];
+        if (a < 0 && b >= 0)
+        {
+            last = i - 1 + (double)-a / (b - a);                                    // Interpolated position
+            if (first < 0) first = last; else crossings++;
+        }
+    }
+    for (i = 0;i < rate;i++) total += (double)data[rate+i] * data[rate+i] / rate;
+    for (f = FREQUENCY;f < rate / 2;f += FREQUENCY)                                 // One second = whole cycles
+        harmonic += BENCH_Energy(data+rate,rate,rate,f);
+    printf("%-6s %6d Hz : tone %9.3f Hz   alias %7.1f dB\n",name,rate,
+                    crossings * rate / (last - first),10.0 * log10((total - harmonic) / harmonic));
+    free(data);
+}
+
+//*******************************************************************************************************
+//                          Time SECONDS worth of tone in callback sized lumps
+//*******************************************************************************************************
+
+static void BENCH_Cost(char *name,RENDERER render,int rate)
+{
+    int i,n = rate * SECONDS / CALLBACK;
+    INT16 buffer[CALLBACK];
+    clock_t start;
+    double elapsed;
+    BEEP_Initialise(rate,FREQUENCY);
+    start = clock();
+    for (i = 0;i < n;i++)
+    {
+        BEEP_SetGate((i / 8) & 1);                                                  // Q toggles every few callbacks
+        render(buffer,CALLBACK);
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%-6s %6d Hz : %7.2f ns/sample   %8.0fx real time\n",name,rate,
+                    elapsed * 1e9 / ((double)n * CALLBACK),SECONDS / (elapsed > 0 ? elapsed : 1e-9));
+}
+
+//*******************************************************************************************************
+//                                              Main Program
+//*******************************************************************************************************
+
+int main(int argc,char *argv[])
+{
+    int rates[] = { 44100,48000 };
+    int i;
+    for (i = 0;i < 2;i++)
+    {
+        BENCH_Accuracy("naive",BEEP_RenderNaive,rates[i]);
+        BENCH_Accuracy("blep",BEEP_Render,rates[i]);
+    }
+    for (i = 0;i < 2;i++)
+    {
+        BENCH_Cost("naive",BEEP_RenderNaive,rates[i]);
+        BENCH_Cost("blep",BEEP_Render,rates[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Beeper.C
+//      Purpose:    Band Limited Beeper Synthesis
+//      Author:     Paul Robson
+//      Date:       16th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "general.h"
+#include "beeper.h"
+
+// The Studio 2 beeper is a 555 square wave oscillator gated by Q. Rather than generate the square wave a sample
+// at a time (which aliases badly) every edge - oscillator or gate - is placed as a band limited step read from a
+// precomputed table at the correct sub sample position. Edges are found by arithmetic, not by testing every
+// sample, and the samples themselves are produced in blocks of BEEP_BLOCK by simple loops which vectorise.
+
+#define AMPLITUDE       (28000.0f)                                                  // Leaves headroom for the Gibbs overshoot.
+#define LATENCY         (BEEP_TAPS/2)                                               // Step centre is this far after the edge
+
+static float stepTable[BEEP_PHASES][BEEP_TAPS];                                     // Band limited steps (0 -> 1)
+static float accumulator[BEEP_BLOCK+BEEP_TAPS];                                     // Output being built
+static INT16 blockBuffer[BEEP_BLOCK];                                               // Last block rendered
+static int blockPos = BEEP_BLOCK;                                                   // Samples of it already used
+static unsigned int phase;                                                          // Oscillator phase, bit 31 is output
+static unsigned int phaseStep;                                                      // Phase added per sample
+static float level;                                                                 // Settled output level
+static BOOL gateOpen;                                                               // Gate as seen by the synthesiser
+static volatile BOOL gateRequest;                                                   // Gate as set by the emulator (Q)
+static int naivePos;                                                                // Position in wave cycle (naive)
+static int naiveRate,naiveFrequency;                                                // Rate and frequency (naive)
+
+//*******************************************************************************************************
+//                      Build the step table and reset the synthesiser
+//*******************************************************************************************************
+
+void BEEP_Initialise(int sampleRate,int frequency)
+{
+    int i,p,k,n = BEEP_TAPS * BEEP_PHASES;
+    double *sum = (double *)malloc(sizeof(double) * (n+1));                         // Running integral of the impulse
+    double cutoff = 0.45;                                                           // Cut off as a fraction of sample rate
+    sum[0] = 0.0;
+    for (i = 0;i < n;i++)                                                           // Windowed sinc, sampled finely.
+    {
+        double x = ((double)i + 0.5) / BEEP_PHASES - LATENCY;                       // Position in samples from centre
+        double w = 0.42 + 0.5 * cos(M_PI * x / LATENCY) + 0.08 * cos(2 * M_PI * x / LATENCY);
+        double s = (x == 0.0) ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+        sum[i+1] = sum[i] + s * w;
+    }
+    for (p = 0;p < BEEP_PHASES;p++)                                                 // Edge at sample p / BEEP_PHASES
+        for (k = 0;k < BEEP_TAPS;k++)                                               // Value at each following sample
+        {
+            i = k * BEEP_PHASES - p;
+            stepTable[p][k] = (i < 0) ? 0.0f : (float)(sum[i] / sum[n]);            // Normalised so it settles at 1
+        }
+    free(sum);
+
+    for (i = 0;i < BEEP_BLOCK+BEEP_TAPS;i++) accumulator[i] = 0.0f;                 // Silence.
+    blockPos = BEEP_BLOCK;
+    phase = 0;level = 0.0f;gateOpen = gateRequest = FALSE;
+    phaseStep = (unsigned int)((double)frequency * 4294967296.0 / sampleRate);      // Whole cycle is 2^32
+    naivePos = 0;naiveRate = sampleRate;naiveFrequency = frequency;
+}
+
+//*******************************************************************************************************
+//                                  Open or close the gate (Q)
+//*******************************************************************************************************
+
+void BEEP_SetGate(BOOL isOn)
+{
+    gateRequest = (isOn != 0);
+}
+
+//*******************************************************************************************************
+//                  Add a step of the given size at position + fraction in the block
+//*******************************************************************************************************
+
+static void BEEP_AddStep(int position,unsigned int fraction,float size)
+{
+    int k;
+    float *table = stepTable[fraction >> (32-6)];                                   // Top 6 bits of fraction -> phase
+    float *target = accumulator + position;
+    for (k = 0;k < BEEP_TAPS;k++) target[k] += size * table[k];                     // The step itself
+    for (k = position+BEEP_TAPS;k < BEEP_BLOCK+BEEP_TAPS;k++) accumulator[k] += size;// Settled after it.
+    level += size;
+}
+
+//*******************************************************************************************************
+//                                  Render one block of samples
+//*******************************************************************************************************
+
+static void BEEP_RenderBlock(INT16 *stream)
+{
+    int i;
+    float sample;
+    if (gateRequest != gateOpen)                                                    // Gate changed, step at block start
+    {
+        gateOpen = gateRequest;
+        phase = 0;                                                                  // 555 starts from the top
+        BEEP_AddStep(0,0,gateOpen ? AMPLITUDE - level : -level);
+    }
+    if (gateOpen)                                                                   // Find oscillator edges in block
+    {
+        unsigned int position = 0;                                                  // 16.16 sample position in block
+        unsigned int toEdge = 0x80000000U - (phase & 0x7FFFFFFFU);                  // Phase until next half cycle
+        unsigned long long edge = ((unsigned long long)toEdge << 16) / phaseStep;   // Samples to it, 16.16
+        while (position + edge < (BEEP_BLOCK << 16))
+        {
+            position += (unsigned int)edge;
+            BEEP_AddStep(position >> 16,position << 16,level > 0 ? -2*AMPLITUDE : 2*AMPLITUDE);
+            edge = ((unsigned long long)0x80000000U << 16) / phaseStep;             // Then every half cycle
+        }
+        phase += phaseStep * BEEP_BLOCK;
+    }
+    for (i = 0;i < BEEP_BLOCK;i++)                                                  // Convert to 16 bit output
+    {
+        sample = accumulator[i];
+        sample = (sample > 32767.0f) ? 32767.0f : sample;
+        sample = (sample < -32767.0f) ? -32767.0f : sample;
+        stream[i] = (INT16)sample;
+    }
+    memmove(accumulator,accumulator+BEEP_BLOCK,BEEP_TAPS * sizeof(float));          // Carry over steps in progress
+    for (i = BEEP_TAPS;i < BEEP_BLOCK+BEEP_TAPS;i++) accumulator[i] = level;        // Rest is settled level
+}
+
+//*******************************************************************************************************
+//                          Render any number of samples into the stream
+//*******************************************************************************************************
+
+void BEEP_Render(INT16 *stream,int length)
+{
+    int count;
+    while (length > 0)
+    {
+        if (blockPos == BEEP_BLOCK && length >= BEEP_BLOCK)                         // Whole blocks go straight out.
+        {
+            BEEP_RenderBlock(stream);
+            stream += BEEP_BLOCK;length -= BEEP_BLOCK;
+        }
+        else
+        {
+            if (blockPos == BEEP_BLOCK)                                             // Odd lengths, go via the buffer
+            {
+                BEEP_RenderBlock(blockBuffer);
+                blockPos = 0;
+            }
+            count = BEEP_BLOCK - blockPos;
+            if (count > length) count = length;
+            memcpy(stream,blockBuffer+blockPos,count * sizeof(INT16));
+            stream += count;length -= count;blockPos += count;
+        }
+    }
+}
+
+//*******************************************************************************************************
+//                  Render using the original sample at a time square wave (for comparison)
+//*******************************************************************************************************
+
+void BEEP_RenderNaive(INT16 *stream,int length)
+{
+    int i;
+    for (i = 0;i < length;i++)
+    {
+        stream[i] = gateRequest ? (naivePos > naiveRate/2 ? -32767:32767) : 0;     // Square Wave - it's a 555
+        naivePos = (naivePos + naiveFrequency) % naiveRate;
+    }
+}
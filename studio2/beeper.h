@@ -0,0 +1,26 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Beeper.H
+//      Purpose:    Band Limited Beeper Synthesis Header
+//      Author:     Paul Robson
+//      Date:       16th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _BEEPER_H
+#define _BEEPER_H
+
+#include "general.h"
+
+#define BEEP_BLOCK      (16)                                                        // Samples rendered per block
+#define BEEP_PHASES     (64)                                                        // Sub sample positions in step table
+#define BEEP_TAPS       (16)                                                        // Length of each band limited step
+
+void BEEP_Initialise(int sampleRate,int frequency);
+void BEEP_SetGate(BOOL isOn);
+void BEEP_Render(INT16 *stream,int length);
+void BEEP_RenderNaive(INT16 *stream,int length);
+
+#endif // _BEEPER_H
@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "general.h"
 #include "cpu.h"
 #include "system.h"
@@ -48,6 +49,8 @@ static BYTE8 *screenMemory = NULL;
 static BYTE8 scrollOffset;                                                          // Vertical scroll offset e.g. R0 = $nnXX at 29 cycles
 static BYTE8 screenEnabled;                                                         // Screen on (IN 1 on, OUT 1 off)
 static BYTE8 keyboardLatch;                                                         // Value stored in Keyboard Select Latch (Studio 2)
+static WORD16 keypadMask[2];                                                        // Keys pressed on each keypad, bit n = key n
+static unsigned int generation;                                                     // Changes whenever registers or memory might
 
 #ifdef ARDUINO_VERSION
 static BYTE8 studio2RAM[512] __attribute__ ((section (".noinit")));                 // Studio 2's internal RAM (ONLY)
@@ -55,6 +58,33 @@ static BYTE8 studio2RAM[512] __attribute__ ((section (".noinit")));
 static BYTE8 studio24k[4096];                                                       // otherwise the whole 4k.
 #endif
 
+#ifdef INCLUDE_DEBUGGING_SUPPORT
+static void CPU_JournalClear(void);
+#endif
+
+#ifdef HEATMAP
+static WORD16 heatMap[HEAT_KINDS][4096];                                            // Decaying access counts, per kind
+#endif
+
+#ifdef STACK_MONITOR
+static WORD16 stackLow = 0xFFFF;                                                    // Lowest R2 this frame
+static WORD16 stackLastFrame = 0xFFFF;                                              // Lowest R2 last frame
+static WORD16 stackLowest = 0xFFFF;                                                 // Lowest R2 ever
+static WORD16 stackSite[4096];                                                      // Lowest R2 pushed from each address
+static WORD16 stackLimit = 0;                                                       // Break if R2 goes below (0 = off)
+static BOOL stackBreak = FALSE;                                                     // Set when it did
+#endif
+
+#ifdef TRACE_WRITES                                                                 // Last write, for tracerun
+static BOOL traceWrite;
+static WORD16 traceAddress;
+static BYTE8 traceData;
+#endif
+
+#ifdef TRACE_CYCLES                                                                 // Cost of the last instruction, for profile
+static int traceCycles;
+#endif
+
 //*******************************************************************************************************
 //                                      Load Binary image
 //*******************************************************************************************************
@@ -71,22 +101,71 @@ void CPU_LoadBinaryImage(char *fileName)
         address++;
     }
     fclose(f);
+    generation++;
+}
+#endif
+
+//*******************************************************************************************************
+//      Memory accesses made by the 1802. With HEATMAP these are counted, the debugger's own reads
+//                      (which use CPU_ReadMemory directly) are not.
+//*******************************************************************************************************
+
+#ifdef HEATMAP
+static BYTE8 CPU_HeatRead(WORD16 address,int kind)
+{
+    heatMap[kind][address & 0xFFF]++;
+    return CPU_ReadMemory(address);
 }
+
+static void CPU_HeatWrite(WORD16 address,BYTE8 data)
+{
+    heatMap[HEAT_WRITE][address & 0xFFF]++;
+    CPU_WriteMemory(address,data);
+}
+
+#define MEMREAD(a)      CPU_HeatRead(a,HEAT_READ)
+#define MEMFETCH(a)     CPU_HeatRead(a,HEAT_EXECUTE)
+#define MEMWRITE(a,d)   CPU_HeatWrite(a,d)
+#else
+#define MEMREAD(a)      CPU_ReadMemory(a)
+#define MEMFETCH(a)     CPU_ReadMemory(a)
+#define MEMWRITE(a,d)   CPU_WriteMemory(a,d)
+#endif
+
+//*******************************************************************************************************
+//      Stack monitor. The generated code uses STACK(n) after STXD, DEC, SAV and MARK use R(n) as a
+//      stack pointer ; with STACK_MONITOR, R2 is checked there, otherwise it is empty. The stack
+//      instructions are all one byte, so the instruction was at R(P)-1.
+//*******************************************************************************************************
+
+#ifdef STACK_MONITOR
+static void CPU_StackPush(void)
+{
+    WORD16 site = (R[P]-1) & 0xFFF;
+    if (R[2] < stackSite[site]) stackSite[site] = R[2];
+    if (R[2] < stackLow) stackLow = R[2];
+    if (R[2] < stackLowest) stackLowest = R[2];
+    if (R[2] < stackLimit) stackBreak = TRUE;
+}
+
+#define STACK(n)    if ((n) == 2) CPU_StackPush()
+#else
+#define STACK(n)
 #endif
 
 //*******************************************************************************************************
 //                                 Macros to Read/Write memory
 //*******************************************************************************************************
 
-#define READ(a)     CPU_ReadMemory(a)
-#define WRITE(a,d)  CPU_WriteMemory(a,d)
+#define READ(a)     MEMREAD(a)
+#define WRITE(a,d)  MEMWRITE(a,d)
 
 //*******************************************************************************************************
 //   Macros for fetching 1 + 2 BYTE8 operands, Note 2 BYTE8 fetch stores in _temp, 1 BYTE8 returns value
 //*******************************************************************************************************
 
-#define FETCH2()    (CPU_ReadMemory(R[P]++))
-#define FETCH3()    { _temp = CPU_ReadMemory(R[P]++);_temp = (_temp << 8) | CPU_ReadMemory(R[P]++); }
+#define FETCH2()    (MEMFETCH(R[P]++))
+#define FETCH3()    { _temp = MEMFETCH(R[P]++);_temp = (_temp << 8) | MEMFETCH(R[P]++); }
 
 //*******************************************************************************************************
 //                      Macros translating Hardware I/O to hardwareHandler calls
@@ -96,6 +175,17 @@ void CPU_LoadBinaryImage(char *fileName)
 #define UPDATEIO(p,d)   CPU_OutputHandler(p,d)
 #define INPUTIO(p)      CPU_InputHandler(p)
 
+//*******************************************************************************************************
+//      Keypads are latched once a frame, so testing EF3/EF4 is a bit test. Define ACCURATE_KEYPAD to
+//                          read the keypad every time instead (catches mid frame changes)
+//*******************************************************************************************************
+
+static void CPU_LatchKeypads(void)
+{
+    keypadMask[0] = SYSTEM_ReadKeypad(1);
+    keypadMask[1] = SYSTEM_ReadKeypad(2);
+}
+
 static BYTE8 CPU_ReadEFlag(BYTE8 flag)
 {
     BYTE8 retVal = 0;
@@ -105,12 +195,11 @@ static BYTE8 CPU_ReadEFlag(BYTE8 flag)
             retVal = 1;                                                             // Permanently set to '1' so BN1 in interrupts always fails
             break;
         case 3:                                                                     // EF3 detects keypressed on VIP and Elf but differently.
-            SYSTEM_Command(HWC_SETKEYPAD,1);
-            retVal = SYSTEM_Command(HWC_READKEYBOARD,keyboardLatch);
-            break;
         case 4:                                                                     // EF4 is !IN Button
-            SYSTEM_Command(HWC_SETKEYPAD,2);
-            retVal = SYSTEM_Command(HWC_READKEYBOARD,keyboardLatch);
+            #ifdef ACCURATE_KEYPAD
+            CPU_LatchKeypads();
+            #endif
+            retVal = (keypadMask[flag-3] >> keyboardLatch) & 1;                     // EF3 is keypad 1, EF4 keypad 2
             break;
     }
     return retVal;
@@ -166,8 +255,16 @@ void CPU_Reset()
     DF = DF & 1;                                                                    // Make DF a valid value as it is 1-bit.
 
     State = 1;                                                                      // State 1
+    generation++;
     Cycles = STATE_1_CYCLES;                                                        // Run this many cycles.
     screenEnabled = FALSE;
+    CPU_LatchKeypads();                                                             // Read the keypads.
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    CPU_JournalClear();                                                             // Can't step back past a reset
+    #endif
+    #ifdef STACK_MONITOR
+    CPU_ResetStackMonitor();
+    #endif
 
     #ifndef ARDUINO
     int i;                                                                          // PC Version copy code into 4k space.
@@ -203,6 +300,9 @@ BYTE8 CPU_ReadMemory(WORD16 address)
 void CPU_WriteMemory(WORD16 address,BYTE8 data)
 {
     address = address & 0xFFF;
+    #ifdef TRACE_WRITES
+    traceWrite = TRUE;traceAddress = address;traceData = data;                      // Remember it for the tracer
+    #endif
     if (address >= 0x800 && address < 0xA00)                                    // only RAM space is writeable
     {
         #ifdef ARDUINO_VERSION
@@ -210,22 +310,396 @@ void CPU_WriteMemory(WORD16 address,BYTE8 data)
         #else
         studio24k[address] = data;
         #endif
+        generation++;
     }
 }
 
+#ifdef INCLUDE_DEBUGGING_SUPPORT
+
 //*******************************************************************************************************
-//                                         Execute one instruction
+//      Undo journal, for stepping backwards. While it is on each instruction logs a step marker, the
+//      old value of every register it changed and the old value of every RAM byte it wrote. Every
+//      JOURNAL_SEGMENT instructions, or sooner if it reaches JOURNAL_LIMIT entries, a full snapshot starts
+//      a new segment ; the limit makes sure JOURNAL_SNAPSHOTS segments always fit in the ring. When the
+//      journal is full the oldest segment is dropped whole, and stepping back to the start of a segment
+//      restores the snapshot. Only the debugger calls CPU_ExecuteJournalled, when it single steps or steps
+//      over ; CPU_Execute itself has no journal code, and running is not journalled. History is dropped
+//      if anything else changed the state since the last journalled instruction (the generation count
+//      shows this), so it covers the instructions stepped since the debugger last ran freely.
+//*******************************************************************************************************
+
+#define JOURNAL_SIZE        (65536)                                                 // Entries in journal (power of 2)
+#define JOURNAL_SEGMENT     (1024)                                                  // Instructions per segment
+#define JOURNAL_SNAPSHOTS   (JOURNAL_SIZE/JOURNAL_SEGMENT/2)                        // Segments kept (32k instructions)
+#define JOURNAL_REGISTERS   (31)                                                    // Values in a register snapshot
+#define JOURNAL_STEPMAX     (JOURNAL_REGISTERS+2)                                   // Most entries per instruction (+marker,RAM)
+#define JOURNAL_LIMIT       (JOURNAL_SIZE/JOURNAL_SNAPSHOTS-JOURNAL_STEPMAX)        // Entries before a new segment
+
+enum { J_STEP,J_REGISTER,J_MEMORY };                                                // Kinds of journal entry
+
+typedef struct _JournalEntry
+{
+    BYTE8 kind;                                                                     // J_STEP etc.
+    BYTE8 index;                                                                    // Register number, or old byte
+    WORD16 value;                                                                   // Old register value, or address
+} JOURNALENTRY;
+
+typedef struct _Snapshot
+{
+    unsigned int start;                                                             // Journal position at the start
+    WORD16 registers[JOURNAL_REGISTERS];                                            // Registers at the start
+    BYTE8 ram[0x200];                                                               // RAM at the start
+} SNAPSHOT;
+
+static JOURNALENTRY *journal = NULL;                                                // Allocated when first used
+static unsigned int journalHead;                                                    // Next entry, always increases
+static SNAPSHOT *snapshots = NULL;
+static int snapshotFirst,snapshotCount;                                             // Ring of segments
+static int segmentSteps;                                                            // Instructions in the newest segment
+static unsigned int journalGeneration;                                              // Generation the journal ends at
+static BOOL journalBusy = FALSE;                                                    // Journalling this instruction
+static int watchCount = 0;                                                          // Number of addresses watched
+
+static void CPU_SaveRegisters(WORD16 *r)                                            // Everything an instruction can change
+{
+    int i;
+    for (i = 0;i < 16;i++) r[i] = R[i];
+    r[16] = D;r[17] = DF;r[18] = X;r[19] = P;r[20] = T;r[21] = IE;r[22] = Q;
+    r[23] = Cycles;r[24] = State;r[25] = screenEnabled;r[26] = keyboardLatch;r[27] = scrollOffset;
+    r[28] = (screenMemory == NULL) ? 0xFFFF : screenMemory - studio24k;
+    r[29] = keypadMask[0];r[30] = keypadMask[1];
+}
+
+static void CPU_LoadRegister(int n,WORD16 v)
+{
+    if (n < 16) { R[n] = v;return; }
+    switch(n)
+    {
+        case 16:    D = v;break;
+        case 17:    DF = v;break;
+        case 18:    X = v;break;
+        case 19:    P = v;break;
+        case 20:    T = v;break;
+        case 21:    IE = v;break;
+        case 22:    Q = v;SYSTEM_Command(HWC_UPDATEQ,Q);break;                      // Q drives the beeper
+        case 23:    Cycles = (INT16)v;break;
+        case 24:    State = v;break;
+        case 25:    screenEnabled = v;break;
+        case 26:    keyboardLatch = v;break;
+        case 27:    scrollOffset = v;break;
+        case 28:    screenMemory = (v == 0xFFFF) ? NULL : studio24k + v;break;
+        case 29:    keypadMask[0] = v;break;
+        case 30:    keypadMask[1] = v;break;
+    }
+}
+
+static void CPU_JournalAdd(BYTE8 kind,BYTE8 index,WORD16 value)
+{
+    JOURNALENTRY *e = &journal[journalHead++ & (JOURNAL_SIZE-1)];
+    e->kind = kind;e->index = index;e->value = value;
+}
+
+static void CPU_JournalClear(void)
+{
+    snapshotCount = 0;
+}
+
+static void CPU_JournalMemory(WORD16 address)                                       // Called before a RAM write
+{
+    address &= 0xFFF;
+    if (address >= 0x800 && address < 0xA00)
+        CPU_JournalAdd(J_MEMORY,studio24k[address],address);
+}
+
+BYTE8 CPU_ExecuteJournalled()
+{
+    WORD16 before[JOURNAL_REGISTERS],after[JOURNAL_REGISTERS];
+    SNAPSHOT *snap;
+    BYTE8 rState;
+    int i;
+    if (journal == NULL)                                                            // Most sessions never step.
+    {
+        journal = (JOURNALENTRY *)malloc(sizeof(JOURNALENTRY) * JOURNAL_SIZE);
+        snapshots = (SNAPSHOT *)malloc(sizeof(SNAPSHOT) * JOURNAL_SNAPSHOTS);
+    }
+    if (generation != journalGeneration) CPU_JournalClear();                        // Changed elsewhere, history invalid
+    if (snapshotCount == 0 || segmentSteps == JOURNAL_SEGMENT ||                    // New segment needed
+            journalHead - snapshots[(snapshotFirst+snapshotCount-1) % JOURNAL_SNAPSHOTS].start >= JOURNAL_LIMIT)
+    {
+        if (snapshotCount == JOURNAL_SNAPSHOTS)                                     // Full, lose the oldest
+        {
+            snapshotFirst = (snapshotFirst + 1) % JOURNAL_SNAPSHOTS;
+            snapshotCount--;
+        }
+        snap = &snapshots[(snapshotFirst+snapshotCount) % JOURNAL_SNAPSHOTS];
+        snapshotCount++;
+        snap->start = journalHead;
+        CPU_SaveRegisters(snap->registers);
+        for (i = 0;i < 0x200;i++) snap->ram[i] = studio24k[0x800+i];
+        segmentSteps = 0;
+    }
+    CPU_JournalAdd(J_STEP,0,0);
+    CPU_SaveRegisters(before);
+    journalBusy = TRUE;watchCount++;                                                // Counts as a watch, so RAM writes
+    rState = CPU_Execute();                                                         // go through CPU_WatchWrite
+    journalBusy = FALSE;watchCount--;
+    CPU_SaveRegisters(after);
+    for (i = 0;i < JOURNAL_REGISTERS;i++)                                           // Log the ones that changed
+        if (before[i] != after[i]) CPU_JournalAdd(J_REGISTER,i,before[i]);
+    segmentSteps++;
+    journalGeneration = generation;
+    return rState;
+}
+
+//*******************************************************************************************************
+//                  Undo the last journalled instruction. Returns FALSE if there is none.
+//*******************************************************************************************************
+
+BOOL CPU_StepBack()
+{
+    SNAPSHOT *snap = NULL;
+    JOURNALENTRY *e;
+    int i;
+    if (generation != journalGeneration) CPU_JournalClear();
+    if (snapshotCount > 0 && journalHead - snapshots[snapshotFirst].start > JOURNAL_SIZE)
+        CPU_JournalClear();                                                         // Oldest overwritten, can't trust it
+    while (snapshotCount > 0)
+    {
+        snap = &snapshots[(snapshotFirst+snapshotCount-1) % JOURNAL_SNAPSHOTS];
+        if (journalHead != snap->start) break;
+        snapshotCount--;                                                            // Newest segment empty, drop it
+        segmentSteps = JOURNAL_SEGMENT;
+    }
+    if (snapshotCount == 0) return FALSE;
+    do                                                                              // Undo back to the step marker
+    {
+        e = &journal[--journalHead & (JOURNAL_SIZE-1)];
+        if (e->kind == J_REGISTER) CPU_LoadRegister(e->index,e->value);
+        if (e->kind == J_MEMORY) studio24k[e->value] = e->index;
+    } while (e->kind != J_STEP);
+    if (journalHead == snap->start)                                                 // Back at a snapshot, resync to it
+    {
+        for (i = 0;i < JOURNAL_REGISTERS;i++) CPU_LoadRegister(i,snap->registers[i]);
+        for (i = 0;i < 0x200;i++) studio24k[0x800+i] = snap->ram[i];
+    }
+    if (segmentSteps > 0) segmentSteps--;
+    generation++;
+    journalGeneration = generation;
+    return TRUE;
+}
+
+//*******************************************************************************************************
+//      Watchpoints. When any are set instructions are executed by a second copy of the instruction
+//      decoder whose READ/WRITE check the watch table, so there is no cost when there are none.
+//      Instruction and operand fetches are not watched.
+//*******************************************************************************************************
+
+static BYTE8 watchTable[4096];                                                      // WATCH_READ/WRITE/FREEZE bits per address
+static BYTE8 watchHit;                                                              // Set when a watchpoint fires
+static WORD16 watchAddress;                                                         // Address that fired it
+
+void CPU_SetWatch(WORD16 from,WORD16 to,BYTE8 type)
+{
+    int a;
+    for (a = from & 0xFFF;a <= (to & 0xFFF);a++)
+    {
+        if (watchTable[a] != 0) watchCount--;
+        watchTable[a] = (watchTable[a] & WATCH_FREEZE) | (type & WATCH_ACCESS);    // Freezing is kept
+        if (watchTable[a] != 0) watchCount++;
+    }
+    if (generation++ == journalGeneration) journalGeneration = generation;         // Redraw, but keep history
+}
+
+BYTE8 CPU_GetWatch(WORD16 address)
+{
+    return watchTable[address & 0xFFF] & WATCH_ACCESS;
+}
+
+//*******************************************************************************************************
+//      Freeze a RAM byte at its current value. This is a watch whose write hook drops the write, so
+//                              the program can't change it (the debugger can).
+//*******************************************************************************************************
+
+void CPU_SetFreeze(WORD16 address,BOOL isOn)
+{
+    address &= 0xFFF;
+    if (watchTable[address] != 0) watchCount--;
+    watchTable[address] = (watchTable[address] & WATCH_ACCESS) | (isOn ? WATCH_FREEZE : 0);
+    if (watchTable[address] != 0) watchCount++;
+    generation++;
+}
+
+BOOL CPU_IsFrozen(WORD16 address)
+{
+    return (watchTable[address & 0xFFF] & WATCH_FREEZE) != 0;
+}
+
+WORD16 CPU_GetWatchAddress()
+{
+    return watchAddress;
+}
+
+static BYTE8 CPU_WatchRead(WORD16 address)
+{
+    if (watchTable[address & 0xFFF] & WATCH_READ)
+    {
+        watchHit = CPU_WATCHHIT;watchAddress = address & 0xFFF;
+    }
+    return MEMREAD(address);
+}
+
+static void CPU_WatchWrite(WORD16 address,BYTE8 data)
+{
+    if (watchTable[address & 0xFFF] & WATCH_WRITE)
+    {
+        watchHit = CPU_WATCHHIT;watchAddress = address & 0xFFF;
+    }
+    if (watchTable[address & 0xFFF] & WATCH_FREEZE) return;                         // Frozen, ignore it
+    if (journalBusy) CPU_JournalMemory(address);
+    MEMWRITE(address,data);
+}
+
+#undef READ
+#undef WRITE
+#define READ(a)     CPU_WatchRead(a)
+#define WRITE(a,d)  CPU_WatchWrite(a,d)
+
+static BYTE8 CPU_ExecuteWatched(BYTE8 opCode)
+{
+    watchHit = 0;
+    switch(opCode)                                                                  // Execute dependent on the Operation Code
+    {
+        #include "cpu1802.h"
+    }
+    return watchHit;
+}
+
+#undef READ
+#undef WRITE
+#define READ(a)     MEMREAD(a)
+#define WRITE(a,d)  MEMWRITE(a,d)
+
+#endif // INCLUDE_DEBUGGING_SUPPORT
+
+//*******************************************************************************************************
+//      Memory heatmap. Counts fade by 1/8 each frame, so they show what the game is doing now ; a
+//      byte touched n times every frame settles at about 8n.
+//*******************************************************************************************************
+
+#ifdef HEATMAP
+
+static void CPU_HeatDecay(void)
+{
+    int i;
+    WORD16 *h = heatMap[0];
+    for (i = 0;i < HEAT_KINDS*4096;i++) h[i] = (h[i] * 7) >> 3;
+}
+
+WORD16 CPU_GetHeat(WORD16 address,int kind)
+{
+    return heatMap[kind][address & 0xFFF];
+}
+
+//*******************************************************************************************************
+//      Save the heatmap. A .csv file has a line per address touched, anything else is a binary
+//              snapshot : reads, writes then executes, 4096 little endian words each.
+//*******************************************************************************************************
+
+BOOL CPU_SaveHeat(char *fileName)
+{
+    int a,k;
+    char *ext = strrchr(fileName,'.');
+    FILE *f = fopen(fileName,"wb");
+    if (f == NULL) return FALSE;
+    if (ext != NULL && strcmp(ext,".csv") == 0)
+    {
+        fprintf(f,"address,read,write,execute\n");
+        for (a = 0;a < 4096;a++)
+            if (heatMap[HEAT_READ][a] + heatMap[HEAT_WRITE][a] + heatMap[HEAT_EXECUTE][a] != 0)
+                fprintf(f,"%03x,%d,%d,%d\n",a,heatMap[HEAT_READ][a],heatMap[HEAT_WRITE][a],heatMap[HEAT_EXECUTE][a]);
+    }
+    else
+    {
+        for (k = 0;k < HEAT_KINDS;k++)
+            for (a = 0;a < 4096;a++)
+            {
+                fputc(heatMap[k][a] & 0xFF,f);fputc(heatMap[k][a] >> 8,f);
+            }
+    }
+    return fclose(f) == 0;
+}
+
+#endif // HEATMAP
+
+//*******************************************************************************************************
+//      Stack monitor results. The lowest R2 in the last frame or since reset, and the lowest R2 each
+//              instruction pushed at (0xFFFF if none). The limit makes CPU_Execute() return
+//                          CPU_WATCHHIT when R2 goes below it (0 is off).
+//*******************************************************************************************************
+
+#ifdef STACK_MONITOR
+
+void CPU_ResetStackMonitor()
+{
+    int i;
+    for (i = 0;i < 4096;i++) stackSite[i] = 0xFFFF;
+    stackLow = stackLastFrame = stackLowest = 0xFFFF;
+}
+
+WORD16 CPU_GetStackLow(BOOL lastFrame)
+{
+    return lastFrame ? stackLastFrame : stackLowest;
+}
+
+WORD16 CPU_GetStackSite(WORD16 address)
+{
+    return stackSite[address & 0xFFF];
+}
+
+void CPU_SetStackLimit(WORD16 limit)
+{
+    stackLimit = limit;
+}
+
+WORD16 CPU_GetStackLimit()
+{
+    return stackLimit;
+}
+
+#endif // STACK_MONITOR
+
+//*******************************************************************************************************
+//                  Execute one instruction, returns state if switched, ORed with CPU_WATCHHIT
 //*******************************************************************************************************
 
 BYTE8 CPU_Execute()
 {
     BYTE8 rState = 0;
-    BYTE8 opCode = CPU_ReadMemory(R[P]++);
+    BYTE8 opCode = MEMFETCH(R[P]++);
+    #ifdef TRACE_CYCLES
+    INT16 startCycles = Cycles;
+    #endif
     Cycles -= 2;                                                                    // 2 x 8 clock Cycles - Fetch and Execute.
+    generation++;                                                                   // Registers at least will change
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    if (watchCount != 0)                                                            // Watching or journalling memory, use the slow decoder
+        rState = CPU_ExecuteWatched(opCode);
+    else
+    #endif
     switch(opCode)                                                                  // Execute dependent on the Operation Code
     {
         #include "cpu1802.h"
     }
+    #ifdef STACK_MONITOR
+    if (stackBreak)                                                                 // Stack went past the limit
+    {
+        stackBreak = FALSE;
+        rState |= CPU_WATCHHIT;
+    }
+    #endif
+    #ifdef TRACE_CYCLES
+    traceCycles = startCycles - Cycles;                                             // Before a state switch reloads it
+    #endif
     if (Cycles < 0)                                                                 // Time for a state switch.
     {
         switch(State)
@@ -249,9 +723,17 @@ BYTE8 CPU_Execute()
             #endif
             scrollOffset = R[0] & 0xFF;                                             // Get the scrolling offset (for things like the car game)
             SYSTEM_Command(HWC_FRAMESYNC,0);                                        // Synchronise.
+            CPU_LatchKeypads();                                                     // Latch keypads for the next frame
+            #ifdef HEATMAP
+            CPU_HeatDecay();
+            #endif
+            #ifdef STACK_MONITOR
+            stackLastFrame = stackLow;                                              // Start from where R2 is now
+            stackLow = R[2];
+            #endif
             break;
         }
-        rState = (BYTE8)State;                                                      // Return state as state has switched
+        rState |= (BYTE8)State;                                                     // Return state as state has switched
         Cycles--;                                                                   // Time out when cycles goes -ve so deduct 1.
     }
     return rState;
@@ -272,6 +754,30 @@ CPU1802STATE *CPU_ReadState(CPU1802STATE *s)
     return s;
 }
 
+//*******************************************************************************************************
+//                              Update CPU registers (for remote debugging)
+//*******************************************************************************************************
+
+void CPU_WriteState(CPU1802STATE *s)
+{
+    int i;
+    D = s->D;DF = s->DF & 1;X = s->X & 0x0F;P = s->P & 0x0F;T = s->T;IE = s->IE & 1;Q = s->Q & 1;
+    for (i = 0;i < 16;i++) R[i] = s->R[i];
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    CPU_JournalClear();                                                             // History no longer valid
+    #endif
+    generation++;
+}
+
+//*******************************************************************************************************
+//          Get the generation count, which changes if the registers or memory may have changed
+//*******************************************************************************************************
+
+unsigned int CPU_GetGeneration()
+{
+    return generation;
+}
+
 #endif // CPUSTATECODE
 
 //*******************************************************************************************************
@@ -296,6 +802,27 @@ BYTE8 CPU_GetScreenScrollOffset()
     return scrollOffset;
 }
 
+//*******************************************************************************************************
+//          Get the memory write made since the last call, if any (each 1802 instruction makes one at most)
+//*******************************************************************************************************
+
+#ifdef TRACE_WRITES
+BOOL CPU_GetTraceWrite(WORD16 *address,BYTE8 *data)
+{
+    BOOL wrote = traceWrite;
+    *address = traceAddress;*data = traceData;
+    traceWrite = FALSE;
+    return wrote;
+}
+#endif
+
+#ifdef TRACE_CYCLES
+int CPU_GetTraceCycles(void)
+{
+    return traceCycles;
+}
+#endif
+
 //*******************************************************************************************************
 //                                        Get Program Counter value
 //*******************************************************************************************************
@@ -14,6 +14,8 @@
 
 #include "general.h"
 
+#define CPU_WATCHHIT    (0x80)                                                      // CPU_Execute() return if a watch fired
+
 BYTE8 CPU_Execute();
 void CPU_Reset();
 BYTE8  CPU_ReadMemory(WORD16 address);
@@ -32,6 +34,55 @@ typedef struct _CPU1802_STATE
 } CPU1802STATE;
 
 CPU1802STATE *CPU_ReadState(CPU1802STATE *s);
+void CPU_WriteState(CPU1802STATE *s);
+unsigned int CPU_GetGeneration();
+
+#endif
+
+#ifdef TRACE_WRITES
+BOOL CPU_GetTraceWrite(WORD16 *address,BYTE8 *data);
+#endif
+
+#ifdef TRACE_CYCLES
+int CPU_GetTraceCycles(void);
+#endif
+
+#ifdef HEATMAP
+
+#define HEAT_READ       (0)                                                         // Heatmap access kinds
+#define HEAT_WRITE      (1)
+#define HEAT_EXECUTE    (2)                                                         // Instruction and operand fetches
+#define HEAT_KINDS      (3)
+
+WORD16 CPU_GetHeat(WORD16 address,int kind);
+BOOL CPU_SaveHeat(char *fileName);
+
+#endif
+
+#ifdef STACK_MONITOR
+
+void CPU_ResetStackMonitor();
+WORD16 CPU_GetStackLow(BOOL lastFrame);
+WORD16 CPU_GetStackSite(WORD16 address);
+void CPU_SetStackLimit(WORD16 limit);
+WORD16 CPU_GetStackLimit();
+
+#endif
+
+#ifdef INCLUDE_DEBUGGING_SUPPORT
+
+#define WATCH_READ      (1)                                                         // Watchpoint types
+#define WATCH_WRITE     (2)
+#define WATCH_ACCESS    (3)
+#define WATCH_FREEZE    (4)                                                         // Writes ignored (see CPU_SetFreeze)
+
+void CPU_SetWatch(WORD16 from,WORD16 to,BYTE8 type);
+BYTE8 CPU_GetWatch(WORD16 address);
+WORD16 CPU_GetWatchAddress();
+void CPU_SetFreeze(WORD16 address,BOOL isOn);
+BOOL CPU_IsFrozen(WORD16 address);
+BYTE8 CPU_ExecuteJournalled();
+BOOL CPU_StepBack();
 
 #endif
 
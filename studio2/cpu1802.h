@@ -97,52 +97,52 @@ case 0x1f: /* "inc rf" */
     R[15]++;
     break;
 case 0x20: /* "dec r0" */
-    R[0]--;
+    R[0]--;STACK(0);
     break;
 case 0x21: /* "dec r1" */
-    R[1]--;
+    R[1]--;STACK(1);
     break;
 case 0x22: /* "dec r2" */
-    R[2]--;
+    R[2]--;STACK(2);
     break;
 case 0x23: /* "dec r3" */
-    R[3]--;
+    R[3]--;STACK(3);
     break;
 case 0x24: /* "dec r4" */
-    R[4]--;
+    R[4]--;STACK(4);
     break;
 case 0x25: /* "dec r5" */
-    R[5]--;
+    R[5]--;STACK(5);
     break;
 case 0x26: /* "dec r6" */
-    R[6]--;
+    R[6]--;STACK(6);
     break;
 case 0x27: /* "dec r7" */
-    R[7]--;
+    R[7]--;STACK(7);
     break;
 case 0x28: /* "dec r8" */
-    R[8]--;
+    R[8]--;STACK(8);
     break;
 case 0x29: /* "dec r9" */
-    R[9]--;
+    R[9]--;STACK(9);
     break;
 case 0x2a: /* "dec ra" */
-    R[10]--;
+    R[10]--;STACK(10);
     break;
 case 0x2b: /* "dec rb" */
-    R[11]--;
+    R[11]--;STACK(11);
     break;
 case 0x2c: /* "dec rc" */
-    R[12]--;
+    R[12]--;STACK(12);
     break;
 case 0x2d: /* "dec rd" */
-    R[13]--;
+    R[13]--;STACK(13);
     break;
 case 0x2e: /* "dec re" */
-    R[14]--;
+    R[14]--;STACK(14);
     break;
 case 0x2f: /* "dec rf" */
-    R[15]--;
+    R[15]--;STACK(15);
     break;
 case 0x30: /* "br .1" */
     _temp = FETCH2();SHORT(_temp);
@@ -346,7 +346,7 @@ case 0x72: /* "ldxa" */
     D = READ(R[X]);R[X]++;
     break;
 case 0x73: /* "stxd" */
-    WRITE(R[X],D);R[X]--;
+    WRITE(R[X],D);R[X]--;STACK(X);
     break;
 case 0x74: /* "adc" */
     ADD(D,READ(R[X]),DF);
@@ -361,10 +361,10 @@ case 0x77: /* "smb" */
     SUB(D,READ(R[X]),DF);
     break;
 case 0x78: /* "sav" */
-    WRITE(R[X],T);
+    WRITE(R[X],T);STACK(X);
     break;
 case 0x79: /* "mark" */
-    T = (X << 4) | P;WRITE(R[2],T);X = P;R[2]--;
+    T = (X << 4) | P;WRITE(R[2],T);X = P;R[2]--;STACK(2);
     break;
 case 0x7a: /* "req" */
     Q = 0;UPDATEIO(0,0);
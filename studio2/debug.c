@@ -18,26 +18,191 @@
 #include "debugscreen.h"
 #include "debug.h"
 #include "cpu.h"
+#include "expression.h"
+#include "debugserver.h"
+#include "search.h"
+#include "symbols.h"
 
 static BOOL inDebugMode = TRUE;                                                     // True if in debugger mode
 static int  programPointer;                                                         // Displayed code
 static int  dataPointer;                                                            // Displayed data
-static int  breakPoint;                                                             // Current break
-static int  lastKey;                                                                // Last key status
+static BYTE8 breakMap[4096/8];                                                      // Execution breakpoints, a bit per address
+static int  breakCount;                                                             // Number of breakpoints set
+static int  stepOver;                                                               // One shot break for step over (-1 = none)
+static BOOL searchPanel = FALSE;                                                    // RAM search panel shown
+static int  searchValue = 0;                                                        // Value for the equals filter
+static BOOL heatView = FALSE;                                                       // Memory heatmap shown
+
+#define MAX_CONDITIONS  (32)                                                        // Conditional breakpoints
+
+typedef struct _Condition
+{
+    BOOL inUse;                                                                     // TRUE if slot used
+    WORD16 address;                                                                 // Where it is
+    int hits;                                                                       // Times the address was reached
+    BYTE8 code[EXPR_MAXCODE];                                                       // Compiled condition
+} CONDITION;
+
+static CONDITION conditions[MAX_CONDITIONS];
+static BYTE8 conditionMap[4096/8];                                                  // Bit set if address has a condition
+
+#define IDLE_WAIT   (250)                                                           // Debugger sleeps this long (ms) if idle
+
+#ifdef INCLUDE_DEBUGGING_SUPPORT
+#define DBG_EXECUTE()   CPU_ExecuteJournalled()                                     // Keep history when single stepping
+#else                                                                               // or stepping over, so it can step back.
+#define DBG_EXECUTE()   CPU_Execute()                                               // Running is never journalled.
+#endif
 
 static void DBG_KeyCommand(char cmd);
+static void DBG_SearchCommand(char cmd);
+#ifdef STACK_MONITOR
+static void DBG_SaveStackReport(char *fileName);
+#endif
 
 //*******************************************************************************************************
 //                                          Full System Reset
 //*******************************************************************************************************
 
+static void DBG_RemoveCondition(WORD16 address);
+
 void DBG_Reset()
 {
+    int i;
     CPU_Reset();                                                                    // Reset CPU define RAM.
     inDebugMode = TRUE;                                                             // Start in Debug Mode
     programPointer = 0x0000;                                                        // Start point
     dataPointer = 0x0800;                                                           // Data at $0000
-    breakPoint = 0xFFFF;                                                            // Break off (effectively)
+    stepOver = -1;                                                                  // Breakpoints are kept.
+    for (i = 0;i < MAX_CONDITIONS;i++) conditions[i].hits = 0;                      // Hit counts are not.
+    DBG_InvalidateScreen();
+}
+
+//*******************************************************************************************************
+//                                      Breakpoint access
+//*******************************************************************************************************
+
+BOOL DBG_IsBreakPoint(WORD16 address)
+{
+    return (breakMap[(address & 0xFFF) >> 3] & (1 << (address & 7))) != 0;
+}
+
+void DBG_SetBreakPoint(WORD16 address,BOOL isOn)
+{
+    if (!isOn) DBG_RemoveCondition(address);
+    if (DBG_IsBreakPoint(address) == isOn) return;
+    breakMap[(address & 0xFFF) >> 3] ^= (1 << (address & 7));
+    breakCount += isOn ? 1 : -1;
+    DBG_InvalidateScreen();
+}
+
+int DBG_BreakPointCount()
+{
+    return breakCount;
+}
+
+//*******************************************************************************************************
+//      Conditional breakpoints. The condition is compiled once, and only evaluated when the PC reaches
+//                  an address with its bit set in the conditionMap (which is also a breakpoint)
+//*******************************************************************************************************
+
+BOOL DBG_HasCondition(WORD16 address)
+{
+    return (conditionMap[(address & 0xFFF) >> 3] & (1 << (address & 7))) != 0;
+}
+
+static CONDITION *DBG_FindCondition(BOOL inUse,WORD16 address)                     // Find used slot at address, or free
+{
+    int i;
+    for (i = 0;i < MAX_CONDITIONS;i++)
+        if (conditions[i].inUse == inUse && (!inUse || conditions[i].address == (address & 0xFFF)))
+            return &conditions[i];
+    return NULL;
+}
+
+static void DBG_RemoveCondition(WORD16 address)
+{
+    CONDITION *c = DBG_FindCondition(TRUE,address);
+    if (c != NULL) c->inUse = FALSE;
+    conditionMap[(address & 0xFFF) >> 3] &= ~(1 << (address & 7));
+}
+
+BOOL DBG_SetCondition(WORD16 address,char *expression)
+{
+    BYTE8 code[EXPR_MAXCODE];
+    CONDITION *c;
+    if (EXPR_Compile(expression,code) == 0) return FALSE;                           // Bad expression, keep the old one
+    c = DBG_FindCondition(TRUE,address);                                            // Replace the one at this address
+    if (c == NULL) c = DBG_FindCondition(FALSE,0);                                  // or find a free slot
+    if (c == NULL) return FALSE;                                                    // Full
+    memcpy(c->code,code,sizeof(code));
+    c->inUse = TRUE;c->address = address & 0xFFF;c->hits = 0;
+    conditionMap[(address & 0xFFF) >> 3] |= (1 << (address & 7));
+    DBG_SetBreakPoint(address,TRUE);
+    DBG_InvalidateScreen();
+    return TRUE;
+}
+
+static BOOL DBG_ConditionMet(WORD16 address)
+{
+    CONDITION *c;
+    if (!DBG_HasCondition(address)) return TRUE;                                    // Plain breakpoint
+    c = DBG_FindCondition(TRUE,address);
+    c->hits++;
+    return EXPR_Evaluate(c->code,c->hits) != 0;
+}
+
+//*******************************************************************************************************
+//      Load breakpoints from a file, each line is <hex address> [<condition>], ; starts a comment
+//*******************************************************************************************************
+
+void DBG_LoadBreakPoints(char *fileName)
+{
+    char line[256],*condition;
+    int address;
+    FILE *f = fopen(fileName,"r");
+    if (f == NULL) exit(printf("Cannot open breakpoint file %s\n",fileName));
+    while (fgets(line,sizeof(line),f) != NULL)
+    {
+        line[strcspn(line,";\r\n")] = '\0';
+        address = strtol(line,&condition,16);
+        if (condition == line) continue;                                            // No address, blank line.
+        while (isspace(*condition)) condition++;
+        if (*condition == '\0')
+            DBG_SetBreakPoint(address,TRUE);
+        else if (!DBG_SetCondition(address,condition))
+            printf("Bad breakpoint condition at %04x : %s\n",address,condition);
+    }
+    fclose(f);
+}
+
+//*******************************************************************************************************
+//      Run until the end of the frame, a breakpoint or a watchpoint. Returns TRUE if a break occurred.
+//      With no breakpoints set this is the same loop as running without a debugger ; with them it is
+//      CPU_Execute and a bitmap test. Only a step over is journalled, as it is a short run.
+//*******************************************************************************************************
+
+static BOOL DBG_Run()
+{
+    BYTE8 r;
+    WORD16 pc;
+    if (breakCount == 0 && stepOver < 0)                                            // Nothing to check.
+    {
+        while ((r = CPU_Execute()) != 1 && r < CPU_WATCHHIT) {}
+        return r >= CPU_WATCHHIT;
+    }
+    do                                                                              // Check the PC each instruction
+    {
+        r = (stepOver >= 0) ? DBG_EXECUTE() : CPU_Execute();
+        pc = CPU_ReadProgramCounter();
+        if (DBG_IsBreakPoint(pc) && DBG_ConditionMet(pc)) return TRUE;
+        if (pc == stepOver)                                                         // Step over break is one shot
+        {
+            stepOver = -1;
+            return TRUE;
+        }
+    } while (r != 1 && r < CPU_WATCHHIT);
+    return r >= CPU_WATCHHIT;
 }
 
 //*******************************************************************************************************
@@ -46,29 +211,24 @@ void DBG_Reset()
 
 void DBG_Execute()
 {
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    SRV_Service();                                                                  // Remote debugger requests
+    #endif
     if (inDebugMode)                                                                // Debug mode
     {
-        int i,currentKey = -1;
-        for (i = ' ';i <= 'Z';i++)                                                  // Get current key pressed
-        {
-            if (IF_KeyPressed(i)) currentKey = i;
-        }
-        if (currentKey != lastKey && currentKey != -1)                              // If key changed and one pressed
-            DBG_KeyCommand(currentKey);                                             // Execute it.
-        lastKey = currentKey;
-        DBG_Draw(programPointer,dataPointer,breakPoint);                            // Update display
+        int key;
+        while ((key = IF_GetKey()) >= 0)                                            // Execute keys pressed
+            DBG_KeyCommand(key);
+        if (!DBG_Draw(programPointer,dataPointer))                                  // Update display if changed
+            IF_WaitForInput(IDLE_WAIT);                                             // otherwise sleep till a key.
     }
     else                                                                            // Run mode
     {
-        while (CPU_Execute() != 1 && CPU_ReadProgramCounter() != breakPoint)        // Execute till end of frame or break
-        {
-        }
-        if (IF_KeyPressed('B') || CPU_ReadProgramCounter() == breakPoint)           // M or break returns to debug mode
-        {
-            inDebugMode = TRUE;
-            programPointer = CPU_ReadProgramCounter();                              // Program pointer at R[P]
-        }
-        if (IF_KeyPressed('P'))                                                     // P is reset
+        BOOL isBreak = DBG_Run();                                                   // Execute till end of frame or break
+        while (IF_GetKey() >= 0) {}                                                 // Debugger keys ignored when running
+        if (IF_KeyPressed(KEY_BREAK) || isBreak)                                    // Break key or break returns to debug mode
+            DBG_Stop();
+        if (IF_KeyPressed(KEY_RESET))                                               // Reset key
         {
             DBG_Reset();
             inDebugMode = FALSE;
@@ -78,6 +238,47 @@ void DBG_Execute()
     }
 }
 
+//*******************************************************************************************************
+//                              Run control, used by the keys and remote debugger
+//*******************************************************************************************************
+
+void DBG_Stop()
+{
+    if (inDebugMode) return;
+    inDebugMode = TRUE;
+    programPointer = CPU_ReadProgramCounter();                                      // Program pointer at R[P]
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    if (CPU_GetWatch(CPU_GetWatchAddress()) != 0)                                   // Show data at the watchpoint hit
+        dataPointer = CPU_GetWatchAddress() & 0xFFF8;
+    SRV_Stopped();                                                                  // Tell the remote debugger
+    #endif
+    DBG_InvalidateScreen();
+}
+
+void DBG_Continue()
+{
+    inDebugMode = FALSE;
+}
+
+void DBG_Step()
+{
+    DBG_EXECUTE();
+    programPointer = CPU_ReadProgramCounter();
+}
+
+void DBG_StepBack(BOOL toBreakPoint)                                                // Back one, or back to a breakpoint
+{
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    while (CPU_StepBack() && toBreakPoint && !DBG_IsBreakPoint(CPU_ReadProgramCounter())) {}
+    #endif
+    programPointer = CPU_ReadProgramCounter();
+}
+
+BOOL DBG_IsRunning()
+{
+    return !inDebugMode;
+}
+
 //*******************************************************************************************************
 //                                          Handle Debug Commands
 //*******************************************************************************************************
@@ -88,42 +289,142 @@ static void DBG_KeyCommand(char cmd)
     {
         int *p = (IF_ShiftPressed()) ? &dataPointer:&programPointer;                // If shift, change data, otherwise change pgm
         int n = (cmd >= 'A') ? cmd - 'A'+10 : cmd - '0';                            // Convert char to decimal
-        *p = ((*p << 4) | n) & 0xFFFF;                                              // Adjust the selected pointer
+        if (searchPanel && IF_ShiftPressed()) p = &searchValue;                     // Search panel, shift sets the value
+        *p = ((*p << 4) | n) & ((p == &searchValue) ? 0xFF : 0xFFFF);               // Adjust the selected pointer
     }
     else
     {
-        int opcode;
+        int opcode,i;
         CPU1802STATE s;                                                             // Read CPU State
         CPU_ReadState(&s);
         switch(cmd)
         {
             case 'P':   DBG_Reset();                                                // P : Reset
                         break;
-            case 'K':   breakPoint = programPointer;                                // K : Set Breakpoint
+            case 'K':   if (IF_ShiftPressed())                                      // Shift K : Clear all breakpoints
+                        {                                                           // and watchpoints
+                            for (i = 0;i < 4096;i++) DBG_SetBreakPoint(i,FALSE);
+                            #ifdef INCLUDE_DEBUGGING_SUPPORT
+                            CPU_SetWatch(0x000,0xFFF,0);
+                            #endif
+                        }
+                        else                                                        // K : Toggle Breakpoint
+                            DBG_SetBreakPoint(programPointer,!DBG_IsBreakPoint(programPointer));
+                        break;
+            #ifdef INCLUDE_DEBUGGING_SUPPORT
+            case 'W':   i = (CPU_GetWatch(dataPointer) + 1) & WATCH_ACCESS;         // W : Cycle watch at data pointer
+                        CPU_SetWatch(dataPointer,dataPointer,i);                    // off, write, read, access
                         break;
+            #endif
             case 'H':   programPointer = s.R[s.P];                                  // H : Display code at R[P]
                         break;
             case 'X':   dataPointer = s.R[s.X];                                     // X : Display data at R[X]
                         break;
-            case 'S':   CPU_Execute();                                              // S : Single step
-                        CPU_ReadState(&s);
-                        programPointer = s.R[s.P];
+            case 'S':   DBG_Step();                                                 // S : Single step
+                        break;
+            case 'G':   DBG_Continue();                                             // G : Run
                         break;
-            case 'G':   inDebugMode = FALSE;                                        // G : Run
+            case 'R':   DBG_StepBack(IF_ShiftPressed());                            // R : Step back, Shift R : back to break
                         break;
             case 'V':   opcode = CPU_ReadMemory(s.R[s.P]);                          // V : Step over
                         if ((opcode & 0xF0) == 0xD0)                                // if SEP R?
                         {
                             inDebugMode = FALSE;                                    // Run with break at R[P]+1
-                            breakPoint = (s.R[s.P]+1) & 0xFFFF;
+                            stepOver = (s.R[s.P]+1) & 0xFFFF;
                         }
                         else                                                        // otherwise same as normal single step
+                            DBG_Step();
+                        break;
+            case 'M':   searchPanel = !searchPanel;                                 // M : RAM search panel on/off
+                        if (searchPanel && SEARCH_Count() == 0) SEARCH_Reset();
+                        break;
+            #ifdef HEATMAP
+            case 'L':   if (IF_ShiftPressed())                                      // Shift L : Save heatmap
                         {
-                            CPU_Execute();
-                            CPU_ReadState(&s);
-                            programPointer = s.R[s.P];
+                            CPU_SaveHeat("heatmap.csv");
+                            CPU_SaveHeat("heatmap.bin");
                         }
+                        else                                                        // L : Memory heatmap on/off
+                            heatView = !heatView;
+                        break;
+            #endif
+            #ifdef STACK_MONITOR
+            case 'J':   CPU_SetStackLimit(IF_ShiftPressed() ? 0 : dataPointer);     // J : Break if R2 below data pointer
+                        DBG_InvalidateScreen();                                     // Shift J : No stack limit
+                        break;
+            case 'O':   DBG_SaveStackReport("stack.txt");                           // O : Save stack use per routine
+                        break;
+            #endif
+            #ifdef INCLUDE_DEBUGGING_SUPPORT
+            case 'Z':   CPU_SetFreeze(dataPointer,!CPU_IsFrozen(dataPointer));      // Z : Freeze byte at data pointer
                         break;
+            #endif
         }
+        if (searchPanel) DBG_SearchCommand(cmd);
     }
+    DBG_SetSearchPanel(searchPanel ? searchValue : -1);
+    DBG_SetHeatView(heatView);
 }
+
+//*******************************************************************************************************
+//      RAM search panel commands. Filters compare RAM now with RAM at the last filter, so run the
+//                                      game between them.
+//*******************************************************************************************************
+
+static void DBG_SearchCommand(char cmd)
+{
+    int next;
+    switch(cmd)
+    {
+        case 'N':   SEARCH_Reset();                                                 // N : New search
+                    break;
+        case 'U':   SEARCH_Filter(IF_ShiftPressed() ? SEARCH_CHANGED : SEARCH_UNCHANGED,0);// U : Unchanged, Shift U : Changed
+                    break;
+        case 'I':   SEARCH_Filter(IF_ShiftPressed() ? SEARCH_DECREASED : SEARCH_INCREASED,0);// I : Increased, Shift I : Decreased
+                    break;
+        case 'Q':   SEARCH_Filter(SEARCH_EQUALS,searchValue);                       // Q : Equals value (Shift+hex sets it)
+                    break;
+        case 'T':   next = SEARCH_Next(dataPointer);                                // T : Next candidate to data pointer
+                    if (next < 0) next = SEARCH_Next(-1);
+                    if (next >= 0) dataPointer = next;
+                    break;
+        default:    return;
+    }
+    DBG_InvalidateScreen();
+}
+
+#ifdef STACK_MONITOR
+
+//*******************************************************************************************************
+//      Write the lowest R2 each routine pushed to. Instructions are grouped by the label before them
+//                      (if there isn't one each instruction is listed on its own)
+//*******************************************************************************************************
+
+static void DBG_SaveStackReport(char *fileName)
+{
+    char name[32],last[32] = "";
+    WORD16 low,routineLow = 0xFFFF;
+    int a;
+    FILE *f = fopen(fileName,"w");
+    if (f == NULL) return;
+    fprintf(f,"Lowest R2 : %04x, last frame %04x\n\n",CPU_GetStackLow(FALSE),CPU_GetStackLow(TRUE));
+    for (a = 0;a < 4096;a++)
+    {
+        if ((low = CPU_GetStackSite(a)) == 0xFFFF) continue;
+        if (SYM_Describe(a,SYM_MAXOFFSET,name,sizeof(name)))
+            strtok(name,"+");                                                       // Label, less the offset
+        else
+            sprintf(name,"%03x",a);
+        if (strcmp(name,last) != 0)                                                 // New routine
+        {
+            if (last[0] != '\0') fprintf(f,"%-24s %04x\n",last,routineLow);
+            strcpy(last,name);
+            routineLow = 0xFFFF;
+        }
+        if (low < routineLow) routineLow = low;
+    }
+    if (last[0] != '\0') fprintf(f,"%-24s %04x\n",last,routineLow);
+    fclose(f);
+}
+
+#endif // STACK_MONITOR
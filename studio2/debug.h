@@ -14,5 +14,16 @@
 
 void DBG_Reset();
 void DBG_Execute();
+BOOL DBG_IsBreakPoint(WORD16 address);
+void DBG_SetBreakPoint(WORD16 address,BOOL isOn);
+int DBG_BreakPointCount();
+BOOL DBG_HasCondition(WORD16 address);
+BOOL DBG_SetCondition(WORD16 address,char *expression);
+void DBG_LoadBreakPoints(char *fileName);
+void DBG_Stop();
+void DBG_Continue();
+void DBG_Step();
+void DBG_StepBack(BOOL toBreakPoint);
+BOOL DBG_IsRunning();
 
 #endif // _DEBUG_H
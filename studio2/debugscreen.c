@@ -15,19 +15,69 @@
 #include "general.h"
 #include "cpu.h"
 #include "hardware.h"
+#include "debug.h"
+#include "symbols.h"
+#include "search.h"
 #include "mnemonics1802.h"
 
 static void DBG_PrintString(int x,int y,char *text,int fgr);
 static void DBG_PrintHex(int x,int y,int n,int fgr,int w);
+static void DBG_PrintSymbol(int x,int y,char *prefix,WORD16 address);
+static void DBG_DrawSearch(int dataPointer);
+#ifdef HEATMAP
+static int DBG_HeatColour(WORD16 address);
+static void DBG_DrawHeatRow(int y,WORD16 address);
+#endif
+
+static BOOL screenValid = FALSE;                                                    // FALSE if the screen must be repainted
+static unsigned int lastGeneration;                                                 // What was last drawn
+static int lastProgramPointer,lastDataPointer;
+static int searchValue = -1;                                                        // RAM search value, -1 if panel off
+static BOOL heatView = FALSE;                                                       // Memory dump coloured by heat
+
+//*******************************************************************************************************
+//                  Force a complete repaint next time (e.g. coming back from run mode)
+//*******************************************************************************************************
+
+void DBG_InvalidateScreen()
+{
+    screenValid = FALSE;
+}
 
 //*******************************************************************************************************
-//                                      Draw the debugger screen
+//              Show the RAM search panel (instead of memory) with the given value, or -1 to hide
 //*******************************************************************************************************
 
-void DBG_Draw(int programPointer,int dataPointer,int breakPoint)
+void DBG_SetSearchPanel(int value)
+{
+    if (value != searchValue) screenValid = FALSE;
+    searchValue = value;
+}
+
+//*******************************************************************************************************
+//                      Colour the memory dump by how often the 1802 accesses it
+//*******************************************************************************************************
+
+void DBG_SetHeatView(BOOL isOn)
+{
+    if (isOn != heatView) screenValid = FALSE;
+    heatView = isOn;
+}
+
+//*******************************************************************************************************
+//          Draw the debugger screen, if anything has changed. Returns TRUE if it was redrawn
+//*******************************************************************************************************
+
+BOOL DBG_Draw(int programPointer,int dataPointer)
 {
     char *labels[] = { "D","DF","P","RP","X","RX","MX","Q","IE","T",NULL };
     int i = 0;
+    if (screenValid && CPU_GetGeneration() == lastGeneration && programPointer == lastProgramPointer &&
+                    dataPointer == lastDataPointer) return FALSE;
+    IF_ClearText(!screenValid);                                                     // Rewrite it all, changes get drawn
+    screenValid = TRUE;
+    lastGeneration = CPU_GetGeneration();
+    lastProgramPointer = programPointer;lastDataPointer = dataPointer;
     while (labels[i] != NULL)
     {
         DBG_PrintString(15,i,labels[i],2);
@@ -45,44 +95,75 @@ void DBG_Draw(int programPointer,int dataPointer,int breakPoint)
     DBG_PrintHex(18,i++,CPU_ReadMemory(s.R[s.X]),3,2);DBG_PrintHex(18,i++,s.Q,3,1);DBG_PrintHex(18,i++,s.IE,3,1);
     DBG_PrintHex(18,i++,s.T,3,2);
     i = 7;
-    DBG_PrintHex(27,i++,breakPoint,3,4);DBG_PrintHex(27,i++,s.Cycles,3,4);DBG_PrintHex(27,i++,s.State,3,1);
+    DBG_PrintHex(27,i++,DBG_BreakPointCount(),3,4);DBG_PrintHex(27,i++,s.Cycles,3,4);DBG_PrintHex(27,i++,s.State,3,1);
+    #ifdef STACK_MONITOR
+    DBG_PrintString(24,6,"SL",2);                                                   // Lowest R2 last frame, red if
+    i = CPU_GetStackLow(TRUE);                                                      // below the break limit
+    DBG_PrintHex(27,6,i,(i < CPU_GetStackLimit()) ? 1 : 3,4);
+    #endif
     for (i = 0;i < 16;i++)
     {
         DBG_PrintString(i%4*8,i/4+11,"R",2);
         DBG_PrintHex(i%4*8+1,i/4+11,i,2,1);
         DBG_PrintHex(i%4*8+3,i/4+11,s.R[i],3,4);
     }
-    for (i = 0;i < 8;i++)
+    for (i = 0;i < 8 && searchValue < 0;i++)
         DBG_PrintHex(1,i+16,(dataPointer+i*8) & 0xFFFF,2,4);
-    for (i = 0;i < 64;i++)
-        DBG_PrintHex(i % 8 * 3 + 7,i/8+16,CPU_ReadMemory((i+dataPointer) & 0xFFFF),3,2);
+    for (i = 0;i < 64 && searchValue < 0;i++)
+    {
+        int colour = 3;
+        #ifdef INCLUDE_DEBUGGING_SUPPORT
+        if (CPU_GetWatch((i+dataPointer) & 0xFFFF) != 0) colour = 5;                // Watched memory in magenta
+        if (CPU_IsFrozen((i+dataPointer) & 0xFFFF)) colour = 6;                     // Frozen memory in cyan
+        #endif
+        #ifdef HEATMAP
+        if (heatView) colour = DBG_HeatColour((i+dataPointer) & 0xFFFF);
+        if (heatView && i % 8 == 0) DBG_DrawHeatRow(i/8+16,(i+dataPointer) & 0xFFFF);
+        #endif
+        DBG_PrintHex(i % 8 * 3 + 7,i/8+16,CPU_ReadMemory((i+dataPointer) & 0xFFFF),colour,2);
+    }
+    if (searchValue >= 0) DBG_DrawSearch(dataPointer);
+
+    DBG_PrintSymbol(0,10,"PC ",s.R[s.P]);                                          // Where the PC and data are
+    DBG_PrintSymbol(0,15,"DT ",dataPointer);
 
     i = 0;
     while (i < 10)
     {
         char buffer[32];
         int isHome = (programPointer == s.R[s.P]);
+        int opcode = CPU_ReadMemory(programPointer);
+        int target = -1;
         DBG_PrintHex(0,i,programPointer,isHome ? 3 : 2,4);
-        if (programPointer == breakPoint) DBG_PrintString(4,i,"*",6);
-        strcpy(buffer,_mnemonics[CPU_ReadMemory(programPointer++)]);
+        if (DBG_IsBreakPoint(programPointer))                                       // * breakpoint, ? conditional
+            DBG_PrintString(4,i,DBG_HasCondition(programPointer) ? "?":"*",6);
+        strcpy(buffer,_mnemonics[opcode]);
+        programPointer = (programPointer+1) & 0xFFFF;
         if (buffer[strlen(buffer)-2] == '.')
         {
             if (buffer[strlen(buffer)-1] == '1')
             {
                 sprintf(buffer+strlen(buffer)-2,"%02x",CPU_ReadMemory(programPointer));
+                if ((opcode & 0xF0) == 0x30) target = (programPointer & 0xFF00) | CPU_ReadMemory(programPointer);
                 programPointer = (programPointer+1) & 0xFFFF;
             }
             else
             {
                 sprintf(buffer+strlen(buffer)-2,"%02x%02x",CPU_ReadMemory(programPointer),CPU_ReadMemory((programPointer+1) & 0xFFFF));
+                if ((opcode & 0xF0) == 0xC0) target = (CPU_ReadMemory(programPointer) << 8) | CPU_ReadMemory((programPointer+1) & 0xFFFF);
                 programPointer = (programPointer+2) & 0xFFFF;
             }
         }
-        programPointer = programPointer & 0xFFFF;
+        if (target >= 0)                                                            // Branch to a label, show its name
+        {
+            char *operand = strchr(buffer,' ') + 1;
+            SYM_Describe(target,0,operand,15 - 5 - (operand - buffer));
+        }
         DBG_PrintString(5,i,buffer,isHome ? 3 : 2);
         i++;
     }
     IF_DisplayScreen(TRUE,CPU_GetScreenMemoryAddress(),CPU_GetScreenScrollOffset());
+    return TRUE;
 }
 
 //*******************************************************************************************************
@@ -107,3 +188,71 @@ static void DBG_PrintHex(int x,int y,int n,int fgr,int w)
     sprintf(buffer,"%0*x",w,n);
     DBG_PrintString(x,y,buffer,fgr);
 }
+
+//*******************************************************************************************************
+//                  Print an address as label+offset, if there is a label near enough
+//*******************************************************************************************************
+
+static void DBG_PrintSymbol(int x,int y,char *prefix,WORD16 address)
+{
+    char buffer[32];
+    if (!SYM_Describe(address,SYM_MAXOFFSET,buffer,32 - x - strlen(prefix))) return;
+    DBG_PrintString(x,y,prefix,2);
+    DBG_PrintString(x+strlen(prefix),y,buffer,7);
+}
+
+//*******************************************************************************************************
+//      RAM search panel : count and value, then candidates from the data pointer on as address=value
+//*******************************************************************************************************
+
+static void DBG_DrawSearch(int dataPointer)
+{
+    int i,colour,address = -1;
+    DBG_PrintString(0,16,"SEARCH",2);
+    DBG_PrintHex(7,16,SEARCH_Count(),3,3);
+    DBG_PrintString(12,16,"VALUE",2);
+    DBG_PrintHex(18,16,searchValue,3,2);
+    if (dataPointer > SEARCH_BASE && dataPointer < SEARCH_BASE+SEARCH_SIZE) address = dataPointer-1;
+    for (i = 0;i < 28 && (address = SEARCH_Next(address)) >= 0;i++)
+    {
+        colour = (address == dataPointer) ? 7 : 3;                                  // Selected one in white
+        #ifdef INCLUDE_DEBUGGING_SUPPORT
+        if (CPU_IsFrozen(address)) colour = 6;                                      // Frozen in cyan
+        #endif
+        DBG_PrintHex(i % 4 * 8,i / 4 + 17,address,2,3);
+        DBG_PrintString(i % 4 * 8 + 3,i / 4 + 17,"=",2);
+        DBG_PrintHex(i % 4 * 8 + 4,i / 4 + 17,CPU_ReadMemory(address),colour,2);
+    }
+}
+
+#ifdef HEATMAP
+
+//*******************************************************************************************************
+//      Heat colour for a byte : blue untouched, then cyan, green, yellow, red as it gets hotter. Each
+//              step is 8 times the last ; about 8 counts is one access every frame.
+//*******************************************************************************************************
+
+static int DBG_HeatColour(WORD16 address)
+{
+    int heat = CPU_GetHeat(address,HEAT_READ) + CPU_GetHeat(address,HEAT_WRITE) + CPU_GetHeat(address,HEAT_EXECUTE);
+    if (heat == 0) return 4;
+    if (heat < 8) return 6;
+    if (heat < 64) return 2;
+    return (heat < 512) ? 3 : 1;
+}
+
+//*******************************************************************************************************
+//      Right of a row of the dump, what the row is mostly used for : R(ead) W(rite) or X (execute)
+//*******************************************************************************************************
+
+static void DBG_DrawHeatRow(int y,WORD16 address)
+{
+    int i,k,total[HEAT_KINDS] = { 0 },best = HEAT_READ;
+    for (i = 0;i < 8;i++)
+        for (k = 0;k < HEAT_KINDS;k++) total[k] += CPU_GetHeat((address+i) & 0xFFFF,k);
+    for (k = 0;k < HEAT_KINDS;k++)
+        if (total[k] > total[best]) best = k;
+    if (total[best] != 0) DBG_PrintString(31,y,best == HEAT_EXECUTE ? "X" : (best == HEAT_WRITE ? "W":"R"),2);
+}
+
+#endif // HEATMAP
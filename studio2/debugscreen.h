@@ -12,6 +12,9 @@
 #ifndef _DEBUGSCREEN_H
 #define _DEBUGSCREEN_H
 
-void DBG_Draw(int programPointer,int dataPointer,int breakPoint);
+BOOL DBG_Draw(int programPointer,int dataPointer);
+void DBG_InvalidateScreen();
+void DBG_SetSearchPanel(int value);
+void DBG_SetHeatView(BOOL isOn);
 
 #endif // _DEBUGSCREEN_H
@@ -0,0 +1,366 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       DebugServer.C
+//      Purpose:    Remote Debug (GDB remote protocol) Server
+//      Author:     Paul Robson
+//      Date:       19th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "debug.h"
+#include "debugserver.h"
+
+#ifdef INCLUDE_DEBUGGING_SUPPORT
+
+#include <SDL.h>
+
+#ifdef WINDOWS
+#include <winsock2.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET  (-1)
+#define closesocket(s)  close(s)
+#endif
+
+// A subset of the GDB remote serial protocol on a localhost TCP port : ? g G p P m M s c bs bc Z z D k and ^C.
+// Registers (g,p) are numbered R0-RF (0-15, 16 bit big endian) then D DF X P T IE Q (16-22, 8 bit).
+// Z0/Z1 are breakpoints, Z2/Z3/Z4 write/read/access watchpoints. The socket is handled by its own thread,
+// which hands each command to the emulator thread ; that checks for one each frame (SRV_Service) so there
+// is no cost when no client is attached.
+
+#define PACKET_SIZE     (1024)                                                      // Maximum packet size
+
+static int port;                                                                    // Port listened on
+static SOCKET client = INVALID_SOCKET;                                              // Current client
+static SDL_mutex *lock;                                                             // Protects all the below
+static SDL_cond *serviced;                                                          // Signalled when request done
+static volatile BOOL requestPending;                                                // Packet for the emulator thread
+static volatile BOOL breakPending;                                                  // ^C received
+static volatile BOOL waitingForStop;                                                // Continued, reply when it stops
+static volatile BOOL hasStopped;                                                    // Stopped while waitingForStop
+static char request[PACKET_SIZE],reply[PACKET_SIZE];                                // Packet and reply
+static BOOL replyNow;                                                               // FALSE if the reply is deferred
+static BYTE8 inBuffer[256];                                                         // Socket read buffer
+static int inCount,inPos;
+
+static int SRV_Thread(void *data);
+
+//*******************************************************************************************************
+//                          Start the server thread, listening on localhost
+//*******************************************************************************************************
+
+void SRV_Start(int listenPort)
+{
+    #ifdef WINDOWS
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2,2),&wsaData) != 0) return;
+    #endif
+    port = listenPort;
+    lock = SDL_CreateMutex();
+    serviced = SDL_CreateCond();
+    SDL_CreateThread(SRV_Thread,"DebugServer",NULL);
+}
+
+//*******************************************************************************************************
+//                  Wake the emulator thread up if it is sleeping in the debugger
+//*******************************************************************************************************
+
+static void SRV_Wake(void)
+{
+    SDL_Event event;
+    memset(&event,0,sizeof(event));
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+}
+
+//*******************************************************************************************************
+//                                      Hexadecimal helpers
+//*******************************************************************************************************
+
+static int SRV_HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int SRV_Hex(char **p,int digits)                                             // Read hex, digits = 0 any number
+{
+    int n = 0,count = 0;
+    while (SRV_HexDigit(**p) >= 0 && (digits == 0 || count < digits))
+    {
+        n = (n << 4) | SRV_HexDigit(**p);
+        (*p)++;count++;
+    }
+    return n;
+}
+
+//*******************************************************************************************************
+//                      Register access, numbered as described at the top
+//*******************************************************************************************************
+
+static int *SRV_Register(CPU1802STATE *s,int n)
+{
+    int *regs[] = { &s->D,&s->DF,&s->X,&s->P,&s->T,&s->IE,&s->Q };
+    if (n < 16) return &s->R[n];
+    return (n < 23) ? regs[n-16] : NULL;
+}
+
+//*******************************************************************************************************
+//          Execute one command, in the emulator thread. Returns FALSE if the reply is deferred
+//*******************************************************************************************************
+
+static BOOL SRV_Execute(char *cmd,char *out)
+{
+    CPU1802STATE s;
+    BYTE8 watchTypes[3] = { WATCH_WRITE,WATCH_READ,WATCH_ACCESS };                  // For Z2,Z3,Z4
+    int i,n,address,length,type,*r;
+    char command = *cmd++;
+    CPU_ReadState(&s);
+    *out = '\0';
+    switch(command)
+    {
+        case '?':   strcpy(out,"S05");                                              // Why stopped : always a trap
+                    break;
+        case 'g':   for (i = 0;i < 23;i++)                                          // Read all registers
+                        out += sprintf(out,(i < 16) ? "%04x":"%02x",*SRV_Register(&s,i) & 0xFFFF);
+                    break;
+        case 'G':   for (i = 0;i < 23;i++)                                          // Write all registers
+                        *SRV_Register(&s,i) = SRV_Hex(&cmd,(i < 16) ? 4 : 2);
+                    CPU_WriteState(&s);
+                    strcpy(out,"OK");
+                    break;
+        case 'p':   n = SRV_Hex(&cmd,0);r = SRV_Register(&s,n);                     // Read one register
+                    if (r == NULL) strcpy(out,"E01");
+                    else sprintf(out,(n < 16) ? "%04x":"%02x",*r & 0xFFFF);
+                    break;
+        case 'P':   r = SRV_Register(&s,SRV_Hex(&cmd,0));                           // Write one register
+                    if (r == NULL || *cmd++ != '=') { strcpy(out,"E01");break; }
+                    *r = SRV_Hex(&cmd,0);
+                    CPU_WriteState(&s);
+                    strcpy(out,"OK");
+                    break;
+        case 'm':   address = SRV_Hex(&cmd,0);cmd++;length = SRV_Hex(&cmd,0);       // Read memory
+                    if (length > PACKET_SIZE/2-8) length = PACKET_SIZE/2-8;
+                    for (i = 0;i < length;i++)
+                        out += sprintf(out,"%02x",CPU_ReadMemory((address+i) & 0xFFFF));
+                    break;
+        case 'M':   address = SRV_Hex(&cmd,0);cmd++;length = SRV_Hex(&cmd,0);cmd++; // Write memory (RAM only)
+                    for (i = 0;i < length;i++)
+                        CPU_WriteMemory((address+i) & 0xFFFF,SRV_Hex(&cmd,2));
+                    strcpy(out,"OK");
+                    break;
+        case 's':   DBG_Step();                                                     // Step
+                    strcpy(out,"S05");
+                    break;
+        case 'b':   if (*cmd != 's' && *cmd != 'c') break;                          // Reverse step/continue
+                    DBG_StepBack(*cmd == 'c');
+                    strcpy(out,"S05");
+                    break;
+        case 'c':   waitingForStop = TRUE;hasStopped = FALSE;                       // Continue, reply when it stops.
+                    DBG_Continue();
+                    return FALSE;
+        case 'Z':                                                                   // Set/Clear break or watch
+        case 'z':   type = SRV_Hex(&cmd,0);cmd++;address = SRV_Hex(&cmd,0);cmd++;length = SRV_Hex(&cmd,0);
+                    if (type > 4) break;                                            // Not supported
+                    if (type <= 1)
+                        DBG_SetBreakPoint(address,command == 'Z');
+                    else
+                        CPU_SetWatch(address,address+(length > 0 ? length-1 : 0),(command == 'Z') ? watchTypes[type-2] : 0);
+                    strcpy(out,"OK");
+                    break;
+        case 'H':   strcpy(out,"OK");                                               // Only one thread
+                    break;
+        case 'D':   strcpy(out,"OK");                                               // Detach, carries on running
+                    DBG_Continue();
+                    break;
+        case 'q':   if (strncmp(cmd,"Supported",9) == 0) sprintf(out,"PacketSize=%x;ReverseStep+;ReverseContinue+",PACKET_SIZE-8);
+                    if (strcmp(cmd,"Attached") == 0) strcpy(out,"1");
+                    break;
+    }
+    return TRUE;
+}
+
+//*******************************************************************************************************
+//      Called by the emulator thread every frame : carry out any request from the socket thread
+//*******************************************************************************************************
+
+void SRV_Service(void)
+{
+    if (!requestPending && !breakPending) return;                                   // Nothing to do (usual case)
+    SDL_LockMutex(lock);
+    if (breakPending)                                                               // ^C, stop if running
+    {
+        breakPending = FALSE;
+        if (DBG_IsRunning()) DBG_Stop();
+    }
+    if (requestPending)                                                             // Do the command, wake the thread
+    {
+        replyNow = SRV_Execute(request,reply);
+        requestPending = FALSE;
+        SDL_CondSignal(serviced);
+    }
+    SDL_UnlockMutex(lock);
+}
+
+//*******************************************************************************************************
+//                  Called by the debugger when it stops, completes a 'c' command
+//*******************************************************************************************************
+
+void SRV_Stopped(void)
+{
+    SDL_LockMutex(lock);                                                            // SDL mutexes are recursive
+    if (waitingForStop) hasStopped = TRUE;
+    SDL_UnlockMutex(lock);
+}
+
+//*******************************************************************************************************
+//          Read a byte from the client. Returns -1 if nothing within timeout ms, -2 if disconnected
+//*******************************************************************************************************
+
+static int SRV_ReadByte(int timeout)
+{
+    fd_set readSet;
+    struct timeval tv;
+    if (inPos == inCount)
+    {
+        FD_ZERO(&readSet);FD_SET(client,&readSet);
+        tv.tv_sec = timeout / 1000;tv.tv_usec = (timeout % 1000) * 1000;
+        if (select(client+1,&readSet,NULL,NULL,(timeout < 0) ? NULL : &tv) <= 0) return -1;
+        inCount = recv(client,(char *)inBuffer,sizeof(inBuffer),0);
+        inPos = 0;
+        if (inCount <= 0) { inCount = 0;return -2; }
+    }
+    return inBuffer[inPos++];
+}
+
+//*******************************************************************************************************
+//                              Send a packet as $<data>#<checksum>
+//*******************************************************************************************************
+
+static void SRV_SendPacket(char *data)
+{
+    char buffer[PACKET_SIZE+8];
+    int i,checksum = 0;
+    for (i = 0;data[i] != '\0';i++) checksum += (BYTE8)data[i];
+    sprintf(buffer,"$%s#%02x",data,checksum & 0xFF);
+    send(client,buffer,strlen(buffer),0);
+}
+
+//*******************************************************************************************************
+//          Pass a packet to the emulator thread and wait for it to be done. Returns TRUE if the
+//                                      reply should be sent now
+//*******************************************************************************************************
+
+static BOOL SRV_Request(char *packet)
+{
+    BOOL sendNow;
+    SDL_LockMutex(lock);
+    strcpy(request,packet);
+    requestPending = TRUE;
+    SRV_Wake();
+    while (requestPending) SDL_CondWait(serviced,lock);
+    sendNow = replyNow;
+    SDL_UnlockMutex(lock);
+    return sendNow;
+}
+
+//*******************************************************************************************************
+//                          Talk to one client until it disconnects or kills
+//*******************************************************************************************************
+
+static void SRV_Session(void)
+{
+    char packet[PACKET_SIZE];
+    int c,length,checksum,sum,high,low;
+    BOOL tooLong,valid;
+    inCount = inPos = 0;
+    while (1)
+    {
+        if (waitingForStop)                                                         // Running, wait for it to stop
+        {
+            c = SRV_ReadByte(50);                                                   // or a ^C
+            if (c == -2) return;
+            if (c == 0x03) { breakPending = TRUE;SRV_Wake(); }
+            SDL_LockMutex(lock);
+            if (hasStopped)
+            {
+                waitingForStop = hasStopped = FALSE;
+                SRV_SendPacket("S05");
+            }
+            SDL_UnlockMutex(lock);
+            continue;
+        }
+        c = SRV_ReadByte(-1);
+        if (c == -2) return;
+        if (c == 0x03) SRV_SendPacket("S05");                                       // ^C when already stopped
+        if (c != '$') continue;                                                     // Acks and noise ignored.
+        length = sum = 0;tooLong = FALSE;
+        while ((c = SRV_ReadByte(-1)) >= 0 && c != '#')                             // Read packet body
+        {
+            if (length < PACKET_SIZE-1) packet[length++] = c; else tooLong = TRUE;
+            sum += c;
+        }
+        packet[length] = '\0';
+        high = SRV_ReadByte(-1);low = SRV_ReadByte(-1);                             // Two hex digits of checksum
+        if (c < 0 || high < 0 || low < 0) return;                                   // Disconnected
+        checksum = (SRV_HexDigit(high) << 4) | SRV_HexDigit(low);
+        valid = SRV_HexDigit(high) >= 0 && SRV_HexDigit(low) >= 0 &&                // Checksum is hex, matches the
+                            checksum == (sum & 0xFF) && !tooLong;                   // body, and it all fitted
+        send(client,valid ? "+" : "-",1,0);                                         // Ack it, or NAK to have it sent again
+        if (!valid) continue;
+        if (packet[0] == 'k') return;                                               // Kill, just disconnect
+        if (SRV_Request(packet)) SRV_SendPacket(reply);
+    }
+}
+
+//*******************************************************************************************************
+//                      Server thread : accept clients one at a time, for ever
+//*******************************************************************************************************
+
+static int SRV_Thread(void *data)
+{
+    struct sockaddr_in address;
+    int yes = 1;
+    SOCKET listener = socket(AF_INET,SOCK_STREAM,0);
+    if (listener == INVALID_SOCKET) return 0;
+    setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,(char *)&yes,sizeof(yes));
+    memset(&address,0,sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);                               // Local connections only
+    address.sin_port = htons(port);
+    if (bind(listener,(struct sockaddr *)&address,sizeof(address)) != 0 || listen(listener,1) != 0)
+    {
+        printf("Debug server cannot listen on port %d\n",port);
+        closesocket(listener);
+        return 0;
+    }
+    while (1)
+    {
+        client = accept(listener,NULL,NULL);
+        if (client == INVALID_SOCKET) continue;
+        SRV_Session();
+        SDL_LockMutex(lock);                                                        // Gone, forget any continue
+        waitingForStop = hasStopped = FALSE;
+        SDL_UnlockMutex(lock);
+        closesocket(client);
+        client = INVALID_SOCKET;
+    }
+    return 0;
+}
+
+#endif // INCLUDE_DEBUGGING_SUPPORT
@@ -0,0 +1,21 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       DebugServer.H
+//      Purpose:    Remote Debug (GDB remote protocol) Server Header
+//      Author:     Paul Robson
+//      Date:       19th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _DEBUGSERVER_H
+#define _DEBUGSERVER_H
+
+#define SRV_DEFAULT_PORT    (1802)                                                  // localhost TCP port
+
+void SRV_Start(int port);
+void SRV_Service(void);
+void SRV_Stopped(void);
+
+#endif // _DEBUGSERVER_H
@@ -0,0 +1,255 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Expression.C
+//      Purpose:    Breakpoint condition compiler and evaluator
+//      Author:     Paul Robson
+//      Date:       18th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "expression.h"
+
+// Conditions are C like expressions, e.g. "D == 0 && RAM[0x8D2] > 3" or "HITS == 100". Values are D DF X P T
+// IE Q R0-RF PC (R[P]) RX (R[X]) HITS (times the breakpoint has been reached, including this one) and
+// RAM[n] or M[n] (byte in memory). Constants are decimal, 0x or $ hexadecimal, and must fit in 16 bits, so a
+// bigger one is an error rather than being cut down. '=' is the same as '=='.
+// They are compiled once into a little stack based byte code which is run when the breakpoint is reached.
+
+enum { OP_END,OP_CONST,OP_REG,OP_D,OP_DF,OP_X,OP_P,OP_T,OP_IE,OP_Q,OP_PC,OP_RX,OP_HITS,OP_MEM,      // Byte code
+       OP_NOT,OP_NEG,OP_INV,OP_MUL,OP_ADD,OP_SUB,OP_LT,OP_LE,OP_GT,OP_GE,OP_EQ,OP_NE,
+       OP_AND,OP_XOR,OP_OR,OP_LAND,OP_LOR };
+
+static char *source;                                                                // Next character to compile
+static BYTE8 *output;                                                               // Code being compiled
+static int codeSize;                                                                // Bytes of it so far
+static BOOL hasError;                                                               // Set on any error
+
+static void EXPR_LogicalOr(void);
+
+//*******************************************************************************************************
+//                                      Compiler helpers
+//*******************************************************************************************************
+
+static void EXPR_Emit(int byte)
+{
+    if (codeSize >= EXPR_MAXCODE) { hasError = TRUE;return; }
+    output[codeSize++] = byte;
+}
+
+static void EXPR_Skip(void)
+{
+    while (isspace(*source)) source++;
+}
+
+static BOOL EXPR_Match(char *operator)                                              // Take operator if next
+{
+    EXPR_Skip();
+    if (strncmp(source,operator,strlen(operator)) != 0) return FALSE;
+    source += strlen(operator);
+    return TRUE;
+}
+
+static BOOL EXPR_MatchSingle(char operator)                                         // Take & or | but not && or ||
+{
+    EXPR_Skip();
+    if (source[0] != operator || source[1] == operator) return FALSE;
+    source++;
+    return TRUE;
+}
+
+//*******************************************************************************************************
+//                                  Terms : constants, registers, memory
+//*******************************************************************************************************
+
+static void EXPR_Term(void)
+{
+    char name[8];
+    int i = 0,base;
+    long n;
+    static char *names[] = { "D","DF","X","P","T","IE","Q","PC","RX","HITS",NULL };
+    EXPR_Skip();
+    if (EXPR_Match("(")) { EXPR_LogicalOr();if (!EXPR_Match(")")) hasError = TRUE;return; }
+    if (EXPR_Match("!")) { EXPR_Term();EXPR_Emit(OP_NOT);return; }
+    if (EXPR_Match("-")) { EXPR_Term();EXPR_Emit(OP_NEG);return; }
+    if (EXPR_Match("~")) { EXPR_Term();EXPR_Emit(OP_INV);return; }
+    if (isdigit(*source) || *source == '$')                                         // Constant
+    {
+        base = 10;                                                                  // Decimal, so 0452 isn't octal
+        if (*source == '$') { source++;base = 16; }
+        else if (source[0] == '0' && toupper(source[1]) == 'X') { source += 2;base = 16; }
+        if (!isxdigit(*source)) { hasError = TRUE;return; }                         // No sign or spaces, strtol allows them
+        n = strtol(source,&source,base);
+        if (n > 0xFFFF || isalnum(*source)) { hasError = TRUE;return; }             // Doesn't fit, or bad digit
+        EXPR_Emit(OP_CONST);EXPR_Emit(n & 0xFF);EXPR_Emit((n >> 8) & 0xFF);
+        return;
+    }
+    while (isalnum(*source) && i < 7) name[i++] = toupper(*source++);               // Identifier
+    name[i] = '\0';
+    if (strcmp(name,"RAM") == 0 || strcmp(name,"M") == 0)                           // Memory
+    {
+        if (!EXPR_Match("[")) { hasError = TRUE;return; }
+        EXPR_LogicalOr();
+        if (!EXPR_Match("]")) hasError = TRUE;
+        EXPR_Emit(OP_MEM);
+        return;
+    }
+    if (strlen(name) == 2 && name[0] == 'R' && isxdigit(name[1]))                   // R0-RF
+    {
+        EXPR_Emit(OP_REG);EXPR_Emit(isdigit(name[1]) ? name[1]-'0' : name[1]-'A'+10);
+        return;
+    }
+    for (i = 0;names[i] != NULL;i++)                                                // Other registers
+        if (strcmp(name,names[i]) == 0) { EXPR_Emit(OP_D+i);return; }
+    hasError = TRUE;
+}
+
+//*******************************************************************************************************
+//                          Binary operators, by precedence, lowest last
+//*******************************************************************************************************
+
+static void EXPR_Product(void)
+{
+    EXPR_Term();
+    while (EXPR_Match("*")) { EXPR_Term();EXPR_Emit(OP_MUL); }
+}
+
+static void EXPR_Sum(void)
+{
+    EXPR_Product();
+    while (!hasError)
+    {
+        if (EXPR_Match("+")) { EXPR_Product();EXPR_Emit(OP_ADD); }
+        else if (EXPR_Match("-")) { EXPR_Product();EXPR_Emit(OP_SUB); }
+        else return;
+    }
+}
+
+static void EXPR_Compare(void)
+{
+    EXPR_Sum();
+    while (!hasError)
+    {
+        if (EXPR_Match("<=")) { EXPR_Sum();EXPR_Emit(OP_LE); }
+        else if (EXPR_Match(">=")) { EXPR_Sum();EXPR_Emit(OP_GE); }
+        else if (EXPR_Match("<")) { EXPR_Sum();EXPR_Emit(OP_LT); }
+        else if (EXPR_Match(">")) { EXPR_Sum();EXPR_Emit(OP_GT); }
+        else return;
+    }
+}
+
+static void EXPR_Equal(void)
+{
+    EXPR_Compare();
+    while (!hasError)
+    {
+        if (EXPR_Match("==") || EXPR_Match("=")) { EXPR_Compare();EXPR_Emit(OP_EQ); }
+        else if (EXPR_Match("!=")) { EXPR_Compare();EXPR_Emit(OP_NE); }
+        else return;
+    }
+}
+
+static void EXPR_BitAnd(void)
+{
+    EXPR_Equal();
+    while (!hasError && EXPR_MatchSingle('&')) { EXPR_Equal();EXPR_Emit(OP_AND); }
+}
+
+static void EXPR_BitXor(void)
+{
+    EXPR_BitAnd();
+    while (!hasError && EXPR_Match("^")) { EXPR_BitAnd();EXPR_Emit(OP_XOR); }
+}
+
+static void EXPR_BitOr(void)
+{
+    EXPR_BitXor();
+    while (!hasError && EXPR_MatchSingle('|')) { EXPR_BitXor();EXPR_Emit(OP_OR); }
+}
+
+static void EXPR_LogicalAnd(void)
+{
+    EXPR_BitOr();
+    while (!hasError && EXPR_Match("&&")) { EXPR_BitOr();EXPR_Emit(OP_LAND); }
+}
+
+static void EXPR_LogicalOr(void)
+{
+    EXPR_LogicalAnd();
+    while (!hasError && EXPR_Match("||")) { EXPR_LogicalAnd();EXPR_Emit(OP_LOR); }
+}
+
+//*******************************************************************************************************
+//          Compile text into code (EXPR_MAXCODE bytes). Returns the code size, or 0 on error.
+//*******************************************************************************************************
+
+int EXPR_Compile(char *text,BYTE8 *code)
+{
+    source = text;output = code;codeSize = 0;hasError = FALSE;
+    EXPR_LogicalOr();
+    EXPR_Skip();
+    if (*source != '\0') hasError = TRUE;                                           // Must use it all.
+    EXPR_Emit(OP_END);
+    return hasError ? 0 : codeSize;
+}
+
+//*******************************************************************************************************
+//                          Evaluate compiled code against the current CPU state
+//*******************************************************************************************************
+
+int EXPR_Evaluate(BYTE8 *code,int hits)
+{
+    int stack[EXPR_MAXCODE],sp = 0,b;
+    CPU1802STATE s;
+    CPU_ReadState(&s);
+    while (*code != OP_END)
+    {
+        switch(*code++)
+        {
+            case OP_CONST:  stack[sp++] = code[0] | (code[1] << 8);code += 2;break;
+            case OP_REG:    stack[sp++] = s.R[*code++];break;
+            case OP_D:      stack[sp++] = s.D;break;
+            case OP_DF:     stack[sp++] = s.DF;break;
+            case OP_X:      stack[sp++] = s.X;break;
+            case OP_P:      stack[sp++] = s.P;break;
+            case OP_T:      stack[sp++] = s.T;break;
+            case OP_IE:     stack[sp++] = s.IE;break;
+            case OP_Q:      stack[sp++] = s.Q;break;
+            case OP_PC:     stack[sp++] = s.R[s.P];break;
+            case OP_RX:     stack[sp++] = s.R[s.X];break;
+            case OP_HITS:   stack[sp++] = hits;break;
+            case OP_MEM:    stack[sp-1] = CPU_ReadMemory(stack[sp-1] & 0xFFFF);break;
+            case OP_NOT:    stack[sp-1] = !stack[sp-1];break;
+            case OP_NEG:    stack[sp-1] = -stack[sp-1];break;
+            case OP_INV:    stack[sp-1] = ~stack[sp-1];break;
+            default:                                                                // Binary operators
+                b = stack[--sp];
+                switch(code[-1])
+                {
+                    case OP_MUL:    stack[sp-1] *= b;break;
+                    case OP_ADD:    stack[sp-1] += b;break;
+                    case OP_SUB:    stack[sp-1] -= b;break;
+                    case OP_LT:     stack[sp-1] = stack[sp-1] < b;break;
+                    case OP_LE:     stack[sp-1] = stack[sp-1] <= b;break;
+                    case OP_GT:     stack[sp-1] = stack[sp-1] > b;break;
+                    case OP_GE:     stack[sp-1] = stack[sp-1] >= b;break;
+                    case OP_EQ:     stack[sp-1] = stack[sp-1] == b;break;
+                    case OP_NE:     stack[sp-1] = stack[sp-1] != b;break;
+                    case OP_AND:    stack[sp-1] &= b;break;
+                    case OP_XOR:    stack[sp-1] ^= b;break;
+                    case OP_OR:     stack[sp-1] |= b;break;
+                    case OP_LAND:   stack[sp-1] = stack[sp-1] && b;break;
+                    case OP_LOR:    stack[sp-1] = stack[sp-1] || b;break;
+                }
+                break;
+        }
+    }
+    return (sp > 0) ? stack[sp-1] : 0;
+}
@@ -0,0 +1,22 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Expression.H
+//      Purpose:    Breakpoint condition compiler and evaluator header
+//      Author:     Paul Robson
+//      Date:       18th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _EXPRESSION_H
+#define _EXPRESSION_H
+
+#include "general.h"
+
+#define EXPR_MAXCODE    (128)                                                       // Maximum size of compiled condition
+
+int EXPR_Compile(char *text,BYTE8 *code);
+int EXPR_Evaluate(BYTE8 *code,int hits);
+
+#endif // _EXPRESSION_H
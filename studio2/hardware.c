@@ -12,29 +12,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 #include "hardware.h"
+#include "beeper.h"
 
 #include <SDL.h>
 
 #include "font.h"                                                                       // 5 x 7 font data.
 
 //#define SOUND                                                                           // Sound on.
-#define BEEPFREQUENCY   (625)
+#define BEEPFREQUENCY   (625)                                                           // Note the CCT Resistors (470R and 1M) must be wrong !
 
 static SDL_Window *window;
 static SDL_Surface *screen;                                                             // Screen used for rendering
-static BOOL keyStatus[128];                                                             // Status of Keys.
+static SDL_Surface *glyphAtlas = NULL;                                                  // Pre-rendered font, 96 chars x 8 colours
+static int atlasWidth,atlasHeight;                                                      // Character cell size it was built for
+static WORD16 textWanted[24][32];                                                       // Text written (colour << 8 | char)
+static WORD16 textShown[24][32];                                                        // Text currently on the screen
+static int keyQueue[16];                                                                // Debugger key presses waiting
+static int keyQueueHead,keyQueueTail;
+static BYTE8 keyCount[KEY_COUNT];                                                       // Physical keys held down per logical key
+static WORD16 keypadMask[2];                                                            // Keypads as bit masks, bit n = key n
 static BOOL isSoundOn = FALSE;                                                          // Sound status.
-static int cyclePos;                                                                    // Position in wave cycle.
 
-static SDL_Keycode keyConvert[] = {                                                     // Known keyboard keys.
-    SDLK_0,SDLK_1,SDLK_2,SDLK_3,SDLK_4,SDLK_5,SDLK_6,SDLK_7,                            // 0-9 : 0-9
-    SDLK_8,SDLK_9,SDLK_a,SDLK_b,SDLK_c,SDLK_d,SDLK_e,SDLK_f,                            // 10-35 : A-Z
-    SDLK_g,SDLK_h,SDLK_i,SDLK_j,SDLK_k,SDLK_l,SDLK_m,SDLK_n,
-    SDLK_o,SDLK_p,SDLK_q,SDLK_r,SDLK_s,SDLK_t,SDLK_u,SDLK_v,
-    SDLK_w,SDLK_x,SDLK_y,SDLK_z,SDLK_RSHIFT,SDLK_LSHIFT                                 // 36,37 shift keys.
-};
+#define LAYERS  (3)                                                                     // Keypad, debugger and hot key layers
 
+static BYTE8 keyMap[SDL_NUM_SCANCODES][LAYERS];                                         // Logical key per layer for each key (0 = none)
+static BOOL physicalDown[SDL_NUM_SCANCODES];                                            // Physical key status, filters auto repeat
+
+static void IF_LoadKeyMap(char *fileName);
+static void IF_DrawText(void);
 static void audioCallback(void *_beeper, Uint8 *_stream, int _length);
 
 //*******************************************************************************************************
@@ -56,7 +63,9 @@ void IF_Initialise(void)
     if (window == NULL)
         exit(printf("Unable to set video: %s\n", SDL_GetError()));
     screen = SDL_GetWindowSurface(window);
-    for (i = 0; i < 128; i++) keyStatus[i] = FALSE;                                     // Reset all key statuses.
+    for (i = 0; i < KEY_COUNT; i++) keyCount[i] = 0;                                    // Reset all key statuses.
+    keypadMask[0] = keypadMask[1] = 0;
+    IF_LoadKeyMap("keys.cfg");                                                          // Build the key lookup table.
     #ifdef SOUND
     SDL_AudioSpec desiredSpec;                                                          // Create an SDL Audio Specification.
     desiredSpec.freq = 44100;
@@ -66,8 +75,9 @@ void IF_Initialise(void)
     desiredSpec.callback = audioCallback;
     SDL_AudioSpec obtainedSpec;                                                         // Request the specification.
     SDL_OpenAudio(&desiredSpec, &obtainedSpec);
+    BEEP_Initialise(obtainedSpec.freq,BEEPFREQUENCY);                                   // Build the beeper for this rate.
     isSoundOn = FALSE;
-    IF_SetSound(FALSE);                                                                 // Sound off.
+    SDL_PauseAudio(0);                                                                  // Runs always, Q gates the beeper.
     #endif
 }
 
@@ -77,27 +87,42 @@ void IF_Initialise(void)
 
 BOOL IF_Render(BOOL debugMode)
 {
-    int i;
-    SDL_Keycode key;
+    int i,key;
+    SDL_Scancode scanCode;
     SDL_Event event;
-    BOOL quit = FALSE;
+    BOOL quit = FALSE,isDown;
     while(SDL_PollEvent(&event))                                                        // Empty the event queue.
     {
         if (event.type == SDL_KEYUP || event.type == SDL_KEYDOWN)                       // Is it a key event
         {
-            key = event.key.keysym.sym;                                                 // This is the SDL Key Code
-
-            for (i = 0;i < sizeof(keyConvert)/sizeof(SDL_Keycode);i++)                  // Scan through known keys
-                if (key == keyConvert[i])                                               // If found
-                    keyStatus[i < 10 ? i+'0':i-10+'A'] = (event.type == SDL_KEYDOWN);   // Update status.
-            if (key == SDLK_ESCAPE)                                                     // Esc key ends program.
-                                quit = TRUE;
-
+            scanCode = event.key.keysym.scancode;                                       // This is the SDL Scan Code
+            isDown = (event.type == SDL_KEYDOWN);
+            if (scanCode < 0 || scanCode >= SDL_NUM_SCANCODES || physicalDown[scanCode] == isDown) continue;
+            physicalDown[scanCode] = isDown;                                            // Ignore repeats, then update
+            for (i = 0;i < LAYERS;i++)                                                  // the logical key in each layer.
+            {
+                key = keyMap[scanCode][i];
+                if (key == 0) continue;
+                keyCount[key] += isDown ? 1 : -1;
+                if (key >= KEY_PAD1 && key < KEY_PAD2+16)                               // Keypad keys update the masks
+                {
+                    WORD16 bit = 1 << ((key - KEY_PAD1) & 15);
+                    int pad = (key - KEY_PAD1) >> 4;
+                    keypadMask[pad] = (keyCount[key] != 0) ? (keypadMask[pad] | bit) : (keypadMask[pad] & ~bit);
+                }
+                if (key == KEY_QUIT) quit = TRUE;                                       // Quit key ends program.
+                if (debugMode && isDown && key >= ' ' && key <= 'Z')                    // Queue debugger commands
+                {
+                    keyQueue[keyQueueTail] = key;
+                    keyQueueTail = (keyQueueTail + 1) % 16;
+                    if (keyQueueTail == keyQueueHead) keyQueueHead = (keyQueueHead + 1) % 16;
+                }
+            }
         } // end switch
     } // end of message processing
 
+    if (debugMode) IF_DrawText();                                                       // Update changed text cells
     SDL_UpdateWindowSurface(window);                                                    // Flip screens
-    SDL_FillRect(screen, 0, SDL_MapRGB(screen->format, 0, 0, 64));                      // Erase for next time.
     return quit;
 }
 
@@ -107,40 +132,102 @@ BOOL IF_Render(BOOL debugMode)
 
 void IF_Write(int x,int y,char ch,int colour)
 {
-    int xCSize = screen->w / 32;                                                        // Work out character box size.
-    int yCSize = screen->h / 24;
+    if (x < 0 || x >= 32 || y < 0 || y >= 24) return;
+    if (ch <= ' ' || ch > 127) ch = ' ';                                                // Control and space are blank.
+    textWanted[y][x] = ((colour & 7) << 8) | (ch - ' ');                                // Drawn by IF_Render if changed.
+}
+
+//*******************************************************************************************************
+//              Blank all the text. If repaint is set every cell is drawn again, not just changes
+//*******************************************************************************************************
+
+void IF_ClearText(BOOL repaint)
+{
+    int i;
+    for (i = 0;i < 24*32;i++)
+    {
+        textWanted[i/32][i%32] = 0;
+        if (repaint) textShown[i/32][i%32] = 0xFFFF;                                    // Nothing valid is displayed
+    }
+}
+
+//*******************************************************************************************************
+//          Build the glyph atlas for the current character size, one cell per character and colour
+//*******************************************************************************************************
+
+static void IF_BuildAtlas(int xCSize,int yCSize)
+{
+    int ch,colour,xp,yp,pixel;
     SDL_Rect rc;
-    rc.x = xCSize * x;rc.y = yCSize * y;                                                // Erase character background.
-    rc.w = xCSize;rc.h = yCSize;
-    SDL_FillRect(screen,&rc,SDL_MapRGB(screen->format,0,0,64));
-    if (ch <= ' ' || ch > 127) return;                                                  // Don't render control and space.
-    unsigned char *byteData = fontdata + (int)((ch - ' ') * 5);                         // point to the font data
-    int xp,yp,pixel;
+    if (glyphAtlas != NULL) SDL_FreeSurface(glyphAtlas);
+    glyphAtlas = SDL_CreateRGBSurface(0,xCSize * 96,yCSize * 8,screen->format->BitsPerPixel,
+                    screen->format->Rmask,screen->format->Gmask,screen->format->Bmask,screen->format->Amask);
+    if (glyphAtlas == NULL)
+        exit(printf("Unable to create glyph atlas: %s\n", SDL_GetError()));
+    atlasWidth = xCSize;atlasHeight = yCSize;
+    SDL_FillRect(glyphAtlas,NULL,SDL_MapRGB(glyphAtlas->format,0,0,64));               // Character background.
     rc.w = xCSize * 16 / 100;                                                           // Work out pixel sizes
     rc.h = yCSize * 14 / 100;
-    Uint32 fgr = SDL_MapRGB(screen->format,                                             // Foreground colour.
-                    (colour & 1) ? 255:0,(colour & 2) ? 255:0,(colour & 4) ? 255:0);
-    for (xp = 0;xp < 5;xp++)                                                            // Font data is stored vertically
+    for (colour = 0;colour < 8;colour++)
     {
-        rc.x = xp * rc.w + x * xCSize;                                                  // Horizontal value
-        pixel = *byteData++;                                                            // Pixel data for vertical line.
-        for (yp = 0;yp < 7;yp++)                                                        // Work through pixels.
+        Uint32 fgr = SDL_MapRGB(glyphAtlas->format,                                     // Foreground colour.
+                        (colour & 1) ? 255:0,(colour & 2) ? 255:0,(colour & 4) ? 255:0);
+        for (ch = 1;ch < 96;ch++)                                                       // Space (0) is left blank
         {
-            if (pixel & (1 << yp))                                                      // Bit 0 is the top pixel, if set.
+            unsigned char *byteData = fontdata + ch * 5;                                // point to the font data
+            for (xp = 0;xp < 5;xp++)                                                    // Font data is stored vertically
             {
-                rc.y = yp * rc.h + y * yCSize;                                          // Vertical value
-                SDL_FillRect(screen,&rc,fgr);                                           // Draw Cell.
+                rc.x = xp * rc.w + ch * xCSize;                                         // Horizontal value
+                pixel = *byteData++;                                                    // Pixel data for vertical line.
+                for (yp = 0;yp < 7;yp++)                                                // Work through pixels.
+                {
+                    if (pixel & (1 << yp))                                              // Bit 0 is the top pixel, if set.
+                    {
+                        rc.y = yp * rc.h + colour * yCSize;                             // Vertical value
+                        SDL_FillRect(glyphAtlas,&rc,fgr);                               // Draw Cell.
+                    }
+                }
             }
         }
     }
 }
 
+//*******************************************************************************************************
+//          Blit every text cell that differs from what is shown, then clear the frame's text
+//*******************************************************************************************************
+
+static void IF_DrawText(void)
+{
+    int x,y,xCSize = screen->w / 32,yCSize = screen->h / 24;                            // Work out character box size.
+    SDL_Rect src,dst;
+    if (glyphAtlas == NULL || xCSize != atlasWidth || yCSize != atlasHeight)            // New size, new atlas.
+    {
+        IF_BuildAtlas(xCSize,yCSize);
+        for (x = 0;x < 24*32;x++) textShown[x/32][x%32] = 0xFFFF;
+    }
+    src.w = dst.w = xCSize;src.h = dst.h = yCSize;
+    for (y = 0;y < 24;y++)
+    {
+        for (x = 0;x < 32;x++)
+        {
+            WORD16 cell = textWanted[y][x];
+            if (cell == textShown[y][x]) continue;                                      // Unchanged, leave it.
+            textShown[y][x] = cell;
+            src.x = (cell & 0xFF) * xCSize;src.y = (cell >> 8) * yCSize;                // Glyph in the atlas
+            dst.x = x * xCSize;dst.y = y * yCSize;
+            SDL_BlitSurface(glyphAtlas,&src,screen,&dst);
+        }
+    }
+}
+
 //*******************************************************************************************************
 //                              Terminate the interface layer
 //*******************************************************************************************************
 
 void IF_Terminate(void)
 {
+    if (glyphAtlas != NULL) SDL_FreeSurface(glyphAtlas);
+    glyphAtlas = NULL;
     SDL_Quit();
 }
 
@@ -148,9 +235,10 @@ void IF_Terminate(void)
 //                              Check to see if a key is pressed
 //*******************************************************************************************************
 
-BOOL IF_KeyPressed(char ch)
+BOOL IF_KeyPressed(int key)
 {
-    return keyStatus[toupper(ch)];
+    if (key < 128) key = toupper(key);                                                  // Debugger keys are upper case.
+    return keyCount[key] != 0;
 }
 
 //*******************************************************************************************************
@@ -159,7 +247,119 @@ BOOL IF_KeyPressed(char ch)
 
 BOOL IF_ShiftPressed(void)
 {
-    return keyStatus['Z'+1] || keyStatus['Z'+2];
+    return keyCount[KEY_SHIFT] != 0;
+}
+
+//*******************************************************************************************************
+//                          Read keypad 1 or 2 as a mask, bit n set if key n pressed
+//*******************************************************************************************************
+
+WORD16 IF_ReadKeypad(BYTE8 pad)
+{
+    return keypadMask[(pad == 2) ? 1 : 0];
+}
+
+//*******************************************************************************************************
+//                              Bind a physical key to a logical key
+//*******************************************************************************************************
+
+static int IF_KeyLayer(int key)
+{
+    return (key >= KEY_PAD1 && key < KEY_PAD2+16) ? 0 : (key < 128 ? 1 : 2);
+}
+
+static void IF_BindKey(int key,const char *keyName)
+{
+    SDL_Scancode scanCode = SDL_GetScancodeFromName(keyName);
+    if (scanCode <= 0 || scanCode >= SDL_NUM_SCANCODES)
+    {
+        printf("Unknown key name '%s' in key map\n",keyName);
+        return;
+    }
+    keyMap[scanCode][IF_KeyLayer(key)] = key;
+}
+
+static void IF_UnbindKey(int key)
+{
+    int i,layer = IF_KeyLayer(key);
+    for (i = 0;i < SDL_NUM_SCANCODES;i++)
+        if (keyMap[i][layer] == key) keyMap[i][layer] = 0;
+}
+
+//*******************************************************************************************************
+//      Convert a logical key name to its code : pad1.0-pad1.f pad2.0-pad2.f debug.0-debug.z debug.shift
+//                              break reset quit. Returns 0 if not known
+//*******************************************************************************************************
+
+static int IF_LogicalKey(char *name)
+{
+    int i;
+    for (i = 0;name[i] != '\0';i++) name[i] = tolower(name[i]);
+    if (strlen(name) == 6 && strncmp(name,"pad",3) == 0 && name[4] == '.' && isxdigit(name[5]))
+    {
+        if (name[3] == '1' || name[3] == '2')
+            return (name[3] == '1' ? KEY_PAD1 : KEY_PAD2) + (isdigit(name[5]) ? name[5]-'0' : name[5]-'a'+10);
+    }
+    if (strcmp(name,"debug.shift") == 0) return KEY_SHIFT;
+    if (strlen(name) == 7 && strncmp(name,"debug.",6) == 0 && isalnum(name[6])) return toupper(name[6]);
+    if (strcmp(name,"break") == 0) return KEY_BREAK;
+    if (strcmp(name,"reset") == 0) return KEY_RESET;
+    if (strcmp(name,"quit") == 0) return KEY_QUIT;
+    return 0;
+}
+
+//*******************************************************************************************************
+//  Build the key map. Defaults first, then each line of the file is <logical> = <key>[,<key> ...] which
+//          replaces the default keys for that logical key. Key names are SDL names e.g. "Left Shift"
+//*******************************************************************************************************
+
+static void IF_LoadKeyMap(char *fileName)
+{
+    char *pad1 = "X123QWEASD",*pad2 = "M678YUIHJ";                                     // Default Studio 2 keypads.
+    char line[256],name[2],*value,*keyName,*logical;
+    BOOL replaced[KEY_COUNT];
+    int i,key;
+    FILE *f;
+
+    for (i = 0;i < KEY_COUNT;i++) replaced[i] = FALSE;
+    name[1] = '\0';
+    for (i = 0;i < 36;i++)                                                              // Debugger keys 0-9 A-Z
+    {
+        name[0] = (i < 10) ? i+'0' : i-10+'A';
+        IF_BindKey(name[0],name);
+    }
+    IF_BindKey(KEY_SHIFT,"Left Shift");IF_BindKey(KEY_SHIFT,"Right Shift");
+    for (i = 0;pad1[i] != '\0';i++) { name[0] = pad1[i];IF_BindKey(KEY_PAD1+i,name); }
+    for (i = 0;pad2[i] != '\0';i++) { name[0] = pad2[i];IF_BindKey(KEY_PAD2+i,name); }
+    IF_BindKey(KEY_BREAK,"B");IF_BindKey(KEY_RESET,"P");IF_BindKey(KEY_QUIT,"Escape");
+
+    f = fopen(fileName,"r");
+    if (f == NULL) return;                                                              // No file, defaults only.
+    while (fgets(line,sizeof(line),f) != NULL)
+    {
+        line[strcspn(line,";#\r\n")] = '\0';                                            // Remove comments and EOL
+        value = strchr(line,'=');
+        if (value == NULL) continue;
+        *value++ = '\0';
+        logical = strtok(line," \t");
+        key = (logical != NULL) ? IF_LogicalKey(logical) : 0;
+        if (key == 0)
+        {
+            printf("Unknown logical key '%s' in %s\n",line,fileName);
+            continue;
+        }
+        if (!replaced[key]) IF_UnbindKey(key);                                          // First mention replaces default
+        replaced[key] = TRUE;
+        keyName = strtok(value,",");
+        while (keyName != NULL)                                                         // Several keys per logical key
+        {
+            while (isspace(*keyName)) keyName++;
+            for (i = strlen(keyName);i > 0 && isspace(keyName[i-1]);i--) keyName[i-1] = '\0';
+            if (*keyName != '\0') IF_BindKey(key,keyName);
+            keyName = strtok(NULL,",");
+        }
+    }
+    fclose(f);
 }
 
 //*******************************************************************************************************
@@ -174,6 +374,8 @@ void IF_DisplayScreen(BOOL isDebugMode,BYTE8 *screenData,BYTE8 scrollOffset)
     if (isDebugMode)                                                                    // Debug display.
     {
         xc = screen->w*24/32;yc = 0;xs =(screen->w-xc)/64;ys = screen->h*6/24/32;       // Make it fit in space.
+        for (y = 0;y < 6;y++)                                                           // These text cells belong to the
+            for (x = 24;x < 32;x++) textWanted[y][x] = textShown[y][x] = 0;             // display, so are not redrawn.
     }
     rc.x = xc;rc.y = yc;rc.w = xs * 64;rc.h = ys*32;                                    // Erase screen display
     SDL_FillRect(screen,&rc,SDL_MapRGB(screen->format,0,0,0));
@@ -209,7 +411,7 @@ void IF_SetSound(BOOL isOn)
     if (isSoundOn == isOn) return;                                                      // No status change.
     isSoundOn = isOn;                                                                   // Update status
     #ifdef SOUND
-    SDL_PauseAudio(isOn == 0);                                                          // If sound built in, turn on/off.
+    BEEP_SetGate(isOn);                                                                 // If sound built in, turn on/off.
     #endif
 }
 
@@ -219,14 +421,31 @@ void IF_SetSound(BOOL isOn)
 
 static void audioCallback(void *_beeper, Uint8 *_stream, int _length)
 {
-    Sint16 *stream = (Sint16*) _stream;                                                 // Pointer to audio data
-    int length = _length / 2;                                                           // Length of audio data
-    int i;
-    for (i = 0;i < length;i++)                                                          // Fill buffer with data
+    BEEP_Render((INT16 *)_stream,_length / 2);                                          // Band limited square wave - it's a 555
+}
+
+//*******************************************************************************************************
+//                      Get the next debugger key pressed, -1 if there isn't one
+//*******************************************************************************************************
+
+int IF_GetKey(void)
+{
+    int key = -1;
+    if (keyQueueHead != keyQueueTail)
     {
-        stream[i] = (cyclePos > 22050 ? -32767:32767);                                  // Square Wave - it's a 555
-        cyclePos = (cyclePos + BEEPFREQUENCY) % 44100;                                  // Note the CCT Resistors (470R and 1M) must be wrong !
+        key = keyQueue[keyQueueHead];
+        keyQueueHead = (keyQueueHead + 1) % 16;
     }
+    return key;
+}
+
+//*******************************************************************************************************
+//                      Sleep until there is input to process, or the timeout (ms)
+//*******************************************************************************************************
+
+void IF_WaitForInput(int timeout)
+{
+    SDL_WaitEventTimeout(NULL,timeout);                                                 // Leaves the event in the queue.
 }
 
 //*******************************************************************************************************
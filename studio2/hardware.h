@@ -14,14 +14,26 @@
 #ifndef _HARDWARE_H
 #define _HARDWARE_H
 
+#define KEY_SHIFT       ('Z'+1)                                                     // Logical keys below 128 are debugger keys
+#define KEY_PAD1        (128)                                                       // Keypad 1, keys 0-15
+#define KEY_PAD2        (144)                                                       // Keypad 2, keys 0-15
+#define KEY_BREAK       (160)                                                       // Hot keys
+#define KEY_RESET       (161)
+#define KEY_QUIT        (162)
+#define KEY_COUNT       (163)
+
 void IF_Initialise(void);
 BOOL IF_Render(BOOL debugMode);
 void IF_Terminate(void);
 void IF_Write(int x,int y,char ch,int colour);
-BOOL IF_KeyPressed(char ch);
+void IF_ClearText(BOOL repaint);
+BOOL IF_KeyPressed(int key);
 BOOL IF_ShiftPressed(void);
+WORD16 IF_ReadKeypad(BYTE8 pad);
 void IF_DisplayScreen(BOOL isDebugMode,BYTE8 *screenData,BYTE8 scrollOffset);
 void IF_SetSound(BOOL isOn);
 int IF_GetTime(void);
+int IF_GetKey(void);
+void IF_WaitForInput(int timeout);
 
 #endif
@@ -0,0 +1,100 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       JournalTest.C
+//      Purpose:    Regression test for stepping backwards through the undo journal
+//      Author:     Paul Robson
+//      Date:       21st March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "system.h"
+
+// journaltest <binary> <frames>. Runs the binary journalled for the given number of frames, remembering
+// the state after each instruction, then steps back as far as the journal allows checking every state on
+// the way. It then runs on to ROUND_STEP instructions past the last end point and does it again, ROUNDS
+// times, so the end points fall everywhere in a segment ; the journal only overflows just before a new
+// segment. Prints the number of instructions stepped back and mismatches, exits non-zero on any.
+
+#define MAX_STATES  (65536)                                                         // More than the journal can hold
+#define ROUNDS      (64)                                                            // End points to step back from
+#define ROUND_STEP  (37)                                                            // Instructions between end points
+
+typedef struct _State
+{
+    CPU1802STATE cpu;
+    BYTE8 ram[0x200];
+} STATE;
+
+static int frame = 0;                                                               // Frames completed
+static STATE *states;                                                               // Ring of states after each instruction
+
+//*******************************************************************************************************
+//                          System interface : count frames, no keys pressed
+//*******************************************************************************************************
+
+BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
+{
+    if (cmd == HWC_FRAMESYNC) frame++;                                              // No waiting, as fast as possible
+    return 0;
+}
+
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad)
+{
+    return 0;
+}
+
+static void JOURNAL_GetState(STATE *s)
+{
+    int i;
+    memset(s,0,sizeof(STATE));                                                      // So memcmp() sees no padding
+    CPU_ReadState(&s->cpu);
+    for (i = 0;i < 0x200;i++) s->ram[i] = CPU_ReadMemory(0x800+i);
+}
+
+//*******************************************************************************************************
+//                                              Main Program
+//*******************************************************************************************************
+
+static void JOURNAL_Run(unsigned int *count)                                        // One instruction, keep the state
+{
+    CPU_ExecuteJournalled();
+    JOURNAL_GetState(&states[(*count)++ % MAX_STATES]);
+}
+
+int main(int argc,char *argv[])
+{
+    STATE now;
+    unsigned int count = 0,end,back = 0,errors = 0,n;
+    int frames,round;
+    if (argc < 3) exit(fprintf(stderr,"journaltest <binary> <frames>\n"));
+    frames = atoi(argv[2]);
+    states = (STATE *)malloc(sizeof(STATE) * MAX_STATES);
+    CPU_Reset();
+    CPU_LoadBinaryImage(argv[1]);
+    JOURNAL_GetState(&states[count++ % MAX_STATES]);                                // State before the first instruction
+    while (frame < frames) JOURNAL_Run(&count);
+    for (round = 0;round < ROUNDS;round++)
+    {
+        end = count;
+        n = 0;
+        while (n+1 < count && n+1 < MAX_STATES && CPU_StepBack())                   // Back through the history
+        {
+            n++;
+            JOURNAL_GetState(&now);
+            if (memcmp(&now,&states[(count-1-n) % MAX_STATES],sizeof(STATE)) != 0) errors++;
+        }
+        if (n == 0 || n+1 >= MAX_STATES) errors++;                                  // No history, or more than it can hold
+        back += n;
+        count -= n;
+        while (count < end + ROUND_STEP) JOURNAL_Run(&count);                       // Run on past the last end point
+    }
+    printf("Stepped back %u instructions, %u mismatches\n",back,errors);
+    return (errors != 0);
+}
@@ -17,6 +17,8 @@
 #include "cpu.h"
 #include "hardware.h"
 #include "debug.h"
+#include "debugserver.h"
+#include "symbols.h"
 
 //*******************************************************************************************************
 //                                              Main Program
@@ -26,8 +28,16 @@ int main(int argc,char *argv[])
 {
     BOOL quit = FALSE;
     IF_Initialise();                                                                    // Initialise the hardware
+    #ifdef INCLUDE_DEBUGGING_SUPPORT
+    SRV_Start(SRV_DEFAULT_PORT);                                                        // Remote debugger on its own thread
+    #endif
     DBG_Reset();
-    if (argc == 2) CPU_LoadBinaryImage(argv[1]);
+    if (argc >= 2)                                                                      // studio2 <binary> [<breakpoints>]
+    {
+        CPU_LoadBinaryImage(argv[1]);
+        SYM_Load(argv[1]);                                                              // Labels from the asmx listing
+    }
+    if (argc >= 3) DBG_LoadBreakPoints(argv[2]);
     while (!quit)                                                                       // Keep running till finished.
     {
         DBG_Execute();
@@ -0,0 +1,355 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Profile.C
+//      Purpose:    Call graph profiler, following 1802 SEP subroutines and the display interrupt
+//      Author:     Paul Robson
+//      Date:       23rd March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "system.h"
+#include "symbols.h"
+
+// profile <binary> <frames> [<input>] [<folded stacks>]. Runs a ROM headless (input as for tracerun, "-"
+// for none) and prints the cycles used by each routine per frame, including and excluding what it calls.
+// The 1802 has no call instruction, a subroutine is a SEP Rn to a register holding its address, and it
+// returns by SEP back to the caller's program counter register. So a shadow stack of (routine, caller's
+// P, caller's PC) is kept : a SEP to a register that is some frame's caller, still pointing just after the
+// caller's SEP (allowing for inline data bytes) is a return to there, anything else is a call. The
+// caller's PC is checked as code that is never returned to is common ; the BIOS runs its interpreter in
+// R4 and the game is started as one of its R3 handlers, so a later SEP R4 in the game is a call. The
+// display interrupt (P = 1, entry R1) is a frame of its own, popped by RET or DIS. Every stack
+// that used cycles can be written as folded stacks ("a;b;c cycles"), which flamegraph.pl reads. The cost
+// of each instruction is taken from the core itself (built with TRACE_CYCLES), so the two always agree.
+
+#define MAX_ROUTINES    (512)                                                       // Different routines
+#define MAX_NODES       (8192)                                                      // Different call stacks
+#define MAX_DEPTH       (64)                                                        // Shadow stack depth
+#define MAX_INPUT       (1024)                                                      // Input changes
+#define MAX_INLINE      (2)                                                         // Data bytes allowed after a SEP
+
+#define CALLER_NONE     (-1)                                                        // Bottom frame, never returned to
+#define CALLER_IRQ      (-2)                                                        // Interrupt frame
+
+typedef struct _Routine
+{
+    WORD16 entry;                                                                   // Start address
+    BOOL isInterrupt;                                                               // Entered by interrupt
+    long calls;                                                                     // Times entered
+    long inclusive,exclusive;                                                       // Cycles, all frames
+    long frameInclusive;                                                            // Inclusive cycles this frame
+    long peakInclusive;                                                             // Most in any one frame
+} ROUTINE;
+
+typedef struct _Node                                                                // Call tree, one node per stack
+{
+    int routine;
+    int parent,child,sibling;                                                       // Tree links (-1 = none)
+    long cycles;                                                                    // Exclusive cycles in this stack
+} NODE;
+
+typedef struct _Frame                                                               // Shadow stack entry
+{
+    int node;                                                                       // Call tree node
+    int callerP;                                                                    // P to return to (or CALLER_)
+    WORD16 returnAddress;                                                           // Caller's PC after the SEP
+    long start;                                                                     // Cycle count when counted from
+} FRAME;
+
+static ROUTINE routines[MAX_ROUTINES];
+static int routineCount = 0;
+static int routineIndex[4096];                                                      // Routine+1 for an entry, 0 none
+static NODE nodes[MAX_NODES];
+static int nodeCount = 0;
+static FRAME stack[MAX_DEPTH];
+static int depth = 0;
+static long totalCycles = 0;
+static long lostCalls = 0;                                                          // Calls when stack/tables full
+
+static int frame = 0;                                                               // Frames completed
+static int inputCount = 0;
+static int inputFrame[MAX_INPUT],inputPad[MAX_INPUT];
+static WORD16 inputMask[MAX_INPUT];
+
+//*******************************************************************************************************
+//                      System interface : count frames, keypads from the input file
+//*******************************************************************************************************
+
+BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
+{
+    if (cmd == HWC_FRAMESYNC) frame++;                                              // No waiting, as fast as possible
+    return 0;
+}
+
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad)
+{
+    WORD16 mask = 0;
+    int i;
+    for (i = 0;i < inputCount;i++)                                                  // Latest change for this pad
+        if (inputPad[i] == pad && inputFrame[i] <= frame) mask = inputMask[i];
+    return mask;
+}
+
+static void PROF_LoadInput(char *fileName)
+{
+    char line[128];
+    unsigned int mask;
+    FILE *f = fopen(fileName,"r");
+    if (f == NULL) exit(fprintf(stderr,"Cannot open input file %s\n",fileName));
+    while (fgets(line,sizeof(line),f) != NULL && inputCount < MAX_INPUT)
+        if (sscanf(line,"%d %d %x",&inputFrame[inputCount],&inputPad[inputCount],&mask) == 3)
+            inputMask[inputCount++] = mask;
+    fclose(f);
+}
+
+//*******************************************************************************************************
+//                      Find or create the routine at an address, -1 if no room
+//*******************************************************************************************************
+
+static int PROF_Routine(WORD16 entry,BOOL isInterrupt)
+{
+    ROUTINE *r;
+    entry &= 0xFFF;
+    if (routineIndex[entry] != 0) return routineIndex[entry]-1;
+    if (routineCount == MAX_ROUTINES) return -1;
+    r = &routines[routineCount];
+    memset(r,0,sizeof(ROUTINE));
+    r->entry = entry;r->isInterrupt = isInterrupt;
+    routineIndex[entry] = ++routineCount;
+    return routineCount-1;
+}
+
+//*******************************************************************************************************
+//                      Find or create the call tree node for routine called from parent
+//*******************************************************************************************************
+
+static int PROF_Node(int parent,int routine)
+{
+    int n = (parent < 0) ? -1 : nodes[parent].child;
+    while (n >= 0 && nodes[n].routine != routine) n = nodes[n].sibling;
+    if (n >= 0 || nodeCount == MAX_NODES) return n;
+    n = nodeCount++;
+    nodes[n].routine = routine;nodes[n].parent = parent;nodes[n].child = -1;nodes[n].cycles = 0;
+    nodes[n].sibling = (parent < 0) ? -1 : nodes[parent].child;
+    if (parent >= 0) nodes[parent].child = n;
+    return n;
+}
+
+//*******************************************************************************************************
+//      Frame n's inclusive cycles since it was last counted. Only the outermost frame of a routine
+//                          counts, so recursion doesn't count cycles twice.
+//*******************************************************************************************************
+
+static void PROF_CountFrame(int n)
+{
+    int i,routine = nodes[stack[n].node].routine;
+    for (i = 0;i < n;i++)
+        if (nodes[stack[i].node].routine == routine) break;
+    if (i == n) routines[routine].frameInclusive += totalCycles - stack[n].start;
+    stack[n].start = totalCycles;
+}
+
+//*******************************************************************************************************
+//                                  Push a call, pop back to a level
+//*******************************************************************************************************
+
+static void PROF_Call(WORD16 entry,int callerP,WORD16 returnAddress)
+{
+    int routine = PROF_Routine(entry,callerP == CALLER_IRQ);
+    int node = (routine < 0) ? -1 : PROF_Node(depth > 0 ? stack[depth-1].node : -1,routine);
+    if (node < 0 || depth == MAX_DEPTH)                                             // No room, stays in the caller
+    {
+        lostCalls++;
+        return;
+    }
+    routines[routine].calls++;
+    stack[depth].node = node;stack[depth].callerP = callerP;stack[depth].start = totalCycles;
+    stack[depth].returnAddress = returnAddress;
+    depth++;
+}
+
+static void PROF_PopTo(int level)
+{
+    while (depth > level)
+    {
+        PROF_CountFrame(depth-1);
+        depth--;
+    }
+}
+
+//*******************************************************************************************************
+//      P has been changed by SEP to newP, whose register holds pc. Return if it goes back to where a
+//          caller left off (not looking past an interrupt), otherwise it is a call.
+//*******************************************************************************************************
+
+static void PROF_Sep(int oldP,int newP,WORD16 pc,WORD16 returnAddress)
+{
+    int i;
+    for (i = depth-1;i >= 0 && stack[i].callerP != CALLER_IRQ;i--)
+        if (stack[i].callerP == newP && ((pc - stack[i].returnAddress) & 0xFFFF) <= MAX_INLINE)
+        {
+            PROF_PopTo(i);
+            return;
+        }
+    PROF_Call(pc,oldP,returnAddress);
+}
+
+//*******************************************************************************************************
+//      Account for one instruction. before/after are the CPU state around it, opcode the instruction
+//                              and newState what CPU_Execute returned.
+//*******************************************************************************************************
+
+static void PROF_Instruction(BYTE8 opcode,CPU1802STATE *before,CPU1802STATE *after,BYTE8 newState)
+{
+    int i,newP = after->P;
+    BOOL isInterrupt = FALSE;
+    int cycles = CPU_GetTraceCycles();                                              // As the core counted them
+    totalCycles += cycles;
+    if (depth > 0)
+    {
+        nodes[stack[depth-1].node].cycles += cycles;
+        routines[nodes[stack[depth-1].node].routine].exclusive += cycles;
+    }
+    if ((newState & 0x0F) == 2 && after->P == 1 && after->IE == 0 && after->X == 2 &&
+                                    (before->P != 1 || opcode == 0x70 || opcode == 0x71))
+    {
+        isInterrupt = TRUE;                                                         // Interrupted after the instruction,
+        newP = after->T & 0x0F;                                                     // which left P as saved in T
+    }
+    if ((opcode & 0xF0) == 0xD0 && newP != before->P)                               // SEP Rn, call or return
+        PROF_Sep(before->P,newP,after->R[newP],after->R[before->P]);
+    if (opcode == 0x70 || opcode == 0x71)                                           // RET/DIS leave the interrupt
+    {
+        for (i = depth-1;i >= 0 && stack[i].callerP != CALLER_IRQ;i--) {}
+        if (i >= 0) PROF_PopTo(i);
+    }
+    if (isInterrupt) PROF_Call(after->R[1],CALLER_IRQ,0);
+}
+
+//*******************************************************************************************************
+//                      End of frame, add this frame's inclusive cycles to the totals
+//*******************************************************************************************************
+
+static void PROF_EndFrame(void)
+{
+    int i;
+    for (i = 0;i < depth;i++) PROF_CountFrame(i);
+    for (i = 0;i < routineCount;i++)
+    {
+        routines[i].inclusive += routines[i].frameInclusive;
+        if (routines[i].frameInclusive > routines[i].peakInclusive) routines[i].peakInclusive = routines[i].frameInclusive;
+        routines[i].frameInclusive = 0;
+    }
+}
+
+//*******************************************************************************************************
+//                          Name of a routine, its label if there is one
+//*******************************************************************************************************
+
+static char *PROF_Name(int routine,char *buffer)
+{
+    if (!SYM_Describe(routines[routine].entry,0,buffer,24))
+        sprintf(buffer,"%03x",routines[routine].entry);
+    if (routines[routine].isInterrupt) strcat(buffer,"(int)");
+    return buffer;
+}
+
+//*******************************************************************************************************
+//                          Print the routines, highest inclusive cycles first
+//*******************************************************************************************************
+
+static int PROF_CompareInclusive(const void *a,const void *b)
+{
+    long ia = routines[*(int *)a].inclusive,ib = routines[*(int *)b].inclusive;
+    return (ia < ib) ? 1 : (ia > ib) ? -1 : 0;
+}
+
+static void PROF_Report(int frames)
+{
+    int i,order[MAX_ROUTINES];
+    char name[32];
+    for (i = 0;i < routineCount;i++) order[i] = i;
+    qsort(order,routineCount,sizeof(int),PROF_CompareInclusive);
+    printf("%d frames, %ld cycles, %.1f cycles per frame\n\n",frames,totalCycles,(double)totalCycles/frames);
+    printf("%-29s %9s %10s %10s %10s %6s\n","Routine","Calls/fr","Incl/fr","Excl/fr","Peak incl","Incl%");
+    for (i = 0;i < routineCount;i++)
+    {
+        ROUTINE *r = &routines[order[i]];
+        printf("%-29s %9.2f %10.1f %10.1f %10ld %5.1f%%\n",PROF_Name(order[i],name),(double)r->calls/frames,
+                        (double)r->inclusive/frames,(double)r->exclusive/frames,r->peakInclusive,
+                        100.0*r->inclusive/totalCycles);
+    }
+    if (lostCalls != 0) printf("\n%ld calls not followed, tables full\n",lostCalls);
+}
+
+//*******************************************************************************************************
+//                      Write folded stacks, a line per stack that used any cycles
+//*******************************************************************************************************
+
+static void PROF_WriteStack(FILE *f,int n)
+{
+    char name[32];
+    if (nodes[n].parent >= 0)
+    {
+        PROF_WriteStack(f,nodes[n].parent);
+        fputc(';',f);
+    }
+    fputs(PROF_Name(nodes[n].routine,name),f);
+}
+
+static void PROF_WriteFolded(char *fileName)
+{
+    int n;
+    FILE *f = fopen(fileName,"w");
+    if (f == NULL) exit(fprintf(stderr,"Cannot write %s\n",fileName));
+    for (n = 0;n < nodeCount;n++)
+        if (nodes[n].cycles != 0)
+        {
+            PROF_WriteStack(f,n);
+            fprintf(f," %ld\n",nodes[n].cycles);
+        }
+    fclose(f);
+}
+
+//*******************************************************************************************************
+//                                              Main Program
+//*******************************************************************************************************
+
+int main(int argc,char *argv[])
+{
+    CPU1802STATE before,after;
+    BYTE8 opcode,newState;
+    int frames,lastFrame = 0;
+    if (argc < 3) exit(fprintf(stderr,"profile <binary> <frames> [<input>|-] [<folded stacks>]\n"));
+    frames = atoi(argv[2]);
+    if (frames <= 0) exit(fprintf(stderr,"Frames must be at least 1\n"));
+    if (argc >= 4 && strcmp(argv[3],"-") != 0) PROF_LoadInput(argv[3]);
+    CPU_Reset();
+    CPU_LoadBinaryImage(argv[1]);
+    SYM_Load(argv[1]);
+    CPU_ReadState(&before);
+    PROF_Call(before.R[before.P],CALLER_NONE,0);                                      // Start at reset
+    while (frame < frames)
+    {
+        opcode = CPU_ReadMemory(before.R[before.P]);
+        newState = CPU_Execute();
+        CPU_ReadState(&after);
+        PROF_Instruction(opcode,&before,&after,newState);
+        if (frame != lastFrame)
+        {
+            PROF_EndFrame();
+            lastFrame = frame;
+        }
+        before = after;
+    }
+    PROF_Report(frames);
+    if (argc >= 5) PROF_WriteFolded(argv[4]);
+    return 0;
+}
@@ -0,0 +1,116 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Search.C
+//      Purpose:    RAM search (cheat finder)
+//      Author:     Paul Robson
+//      Date:       22nd March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "search.h"
+
+// Finds things like the lives counter by narrowing down : start with every byte of RAM, let the game run,
+// then keep only the bytes that (say) decreased, and so on. The candidates are a bitset, a bit per byte.
+// A filter compares all of RAM against the copy taken at the last filter in one simple loop (which the
+// compiler vectorises), packs the results into 64 bit words and ANDs them with the candidates.
+
+#define WORDS   (SEARCH_SIZE/64)
+
+static unsigned long long candidates[WORDS];                                        // Bit set if still a candidate
+static BYTE8 previous[SEARCH_SIZE];                                                 // RAM at the last filter
+
+//*******************************************************************************************************
+//                                  Copy RAM into a buffer
+//*******************************************************************************************************
+
+static void SEARCH_ReadRAM(BYTE8 *ram)
+{
+    int i;
+    for (i = 0;i < SEARCH_SIZE;i++) ram[i] = CPU_ReadMemory(SEARCH_BASE+i);
+}
+
+//*******************************************************************************************************
+//                              Start a new search, everything is a candidate
+//*******************************************************************************************************
+
+void SEARCH_Reset(void)
+{
+    int i;
+    for (i = 0;i < WORDS;i++) candidates[i] = ~0ULL;
+    SEARCH_ReadRAM(previous);
+}
+
+//*******************************************************************************************************
+//          Keep only the candidates that pass the test. Returns the number of candidates left.
+//*******************************************************************************************************
+
+int SEARCH_Filter(int test,BYTE8 value)
+{
+    BYTE8 now[SEARCH_SIZE],match[SEARCH_SIZE];
+    unsigned long long bits;
+    int i,b;
+    SEARCH_ReadRAM(now);
+    switch(test)                                                                    // 1 if the byte passes
+    {
+        case SEARCH_UNCHANGED:  for (i = 0;i < SEARCH_SIZE;i++) match[i] = (now[i] == previous[i]);break;
+        case SEARCH_CHANGED:    for (i = 0;i < SEARCH_SIZE;i++) match[i] = (now[i] != previous[i]);break;
+        case SEARCH_INCREASED:  for (i = 0;i < SEARCH_SIZE;i++) match[i] = (now[i] > previous[i]);break;
+        case SEARCH_DECREASED:  for (i = 0;i < SEARCH_SIZE;i++) match[i] = (now[i] < previous[i]);break;
+        case SEARCH_EQUALS:     for (i = 0;i < SEARCH_SIZE;i++) match[i] = (now[i] == value);break;
+        default:                return SEARCH_Count();
+    }
+    for (i = 0;i < WORDS;i++)                                                       // Pack into bits, AND with candidates
+    {
+        bits = 0;
+        for (b = 0;b < 64;b++) bits |= (unsigned long long)match[i*64+b] << b;
+        candidates[i] &= bits;
+    }
+    memcpy(previous,now,SEARCH_SIZE);                                               // Next filter compares with this
+    return SEARCH_Count();
+}
+
+//*******************************************************************************************************
+//                                      Number of candidates
+//*******************************************************************************************************
+
+int SEARCH_Count(void)
+{
+    int i,count = 0;
+    unsigned long long bits;
+    for (i = 0;i < WORDS;i++)
+        for (bits = candidates[i];bits != 0;bits &= bits - 1) count++;              // Clears lowest set bit
+    return count;
+}
+
+//*******************************************************************************************************
+//                                  Is this address a candidate ?
+//*******************************************************************************************************
+
+BOOL SEARCH_IsCandidate(WORD16 address)
+{
+    address = (address & 0xFFF) - SEARCH_BASE;
+    if (address >= SEARCH_SIZE) return FALSE;
+    return (candidates[address / 64] >> (address % 64)) & 1;
+}
+
+//*******************************************************************************************************
+//          First candidate after the given address (-1 for the first one). Returns -1 if none.
+//*******************************************************************************************************
+
+int SEARCH_Next(int address)
+{
+    int i = (address < SEARCH_BASE) ? 0 : address - SEARCH_BASE + 1;
+    for (;i < SEARCH_SIZE;i++)
+    {
+        if (candidates[i / 64] == 0) { i = i | 63;continue; }                       // Skip empty words
+        if ((candidates[i / 64] >> (i % 64)) & 1) return SEARCH_BASE + i;
+    }
+    return -1;
+}
@@ -0,0 +1,32 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Search.H
+//      Purpose:    RAM search (cheat finder) header
+//      Author:     Paul Robson
+//      Date:       22nd March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include "general.h"
+
+#define SEARCH_BASE         (0x800)                                                 // RAM searched
+#define SEARCH_SIZE         (0x200)
+
+#define SEARCH_UNCHANGED    (0)                                                     // Filters, comparing RAM now with
+#define SEARCH_CHANGED      (1)                                                     // RAM at the previous filter
+#define SEARCH_INCREASED    (2)
+#define SEARCH_DECREASED    (3)
+#define SEARCH_EQUALS       (4)                                                     // Compares with a value
+
+void SEARCH_Reset(void);
+int SEARCH_Filter(int test,BYTE8 value);
+int SEARCH_Count(void);
+BOOL SEARCH_IsCandidate(WORD16 address);
+int SEARCH_Next(int address);
+
+#endif // _SEARCH_H
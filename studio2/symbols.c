@@ -0,0 +1,197 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Symbols.C
+//      Purpose:    Symbol table (from asmx listings) for the debugger
+//      Author:     Paul Robson
+//      Date:       20th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include "general.h"
+#include "cpu.h"
+#include "symbols.h"
+
+// Labels are read from the symbol table asmx puts at the end of a listing (after "Total Error(s)"), so the
+// listing for game.asm.bin is game.asm.lst. Equates, set and undefined symbols are left out as they are not
+// addresses. The labels are sorted by address so the nearest one at or below an address is a binary search.
+// Nothing is read until the first lookup, and tables are kept by a hash of the ROM so the same ROM is only
+// ever read once.
+
+#define SYM_CACHE   (4)                                                             // ROM tables remembered
+
+typedef struct _Symbol
+{
+    WORD16 address;                                                                 // Label address
+    char *name;                                                                     // Label name
+} SYMBOL;
+
+typedef struct _SymbolTable
+{
+    unsigned int hash;                                                              // Hash of the ROM it is for
+    int count;                                                                      // Number of labels
+    SYMBOL *symbols;                                                                // Labels, sorted by address
+} SYMBOLTABLE;
+
+static SYMBOLTABLE cache[SYM_CACHE];                                                // Loaded tables
+static int nextSlot;                                                                // Next one to replace
+static SYMBOLTABLE *current = NULL;                                                 // Table in use (NULL if none)
+static char pendingFile[256];                                                       // Listing to load
+static BOOL loadPending = FALSE;                                                    // TRUE if not yet loaded
+
+//*******************************************************************************************************
+//              Remember which listing goes with a binary, it is loaded on first use
+//*******************************************************************************************************
+
+void SYM_Load(char *binaryFile)
+{
+    char *dot;
+    strncpy(pendingFile,binaryFile,sizeof(pendingFile)-5);
+    pendingFile[sizeof(pendingFile)-5] = '\0';
+    dot = strrchr(pendingFile,'.');                                                 // game.asm.bin -> game.asm.lst
+    if (dot != NULL && strchr(dot,'/') == NULL && strchr(dot,'\\') == NULL) *dot = '\0';
+    strcat(pendingFile,".lst");
+    loadPending = TRUE;
+    current = NULL;
+}
+
+//*******************************************************************************************************
+//                          FNV-1a hash of the ROM (BIOS and cartridge)
+//*******************************************************************************************************
+
+static unsigned int SYM_RomHash(void)
+{
+    unsigned int hash = 2166136261U;
+    int address;
+    for (address = 0;address < 0x1000;address++)
+    {
+        if (address == 0x800) address = 0xA00;                                      // Skip RAM
+        hash = (hash ^ CPU_ReadMemory(address)) * 16777619U;
+    }
+    return hash;
+}
+
+//*******************************************************************************************************
+//                                  Sort by address, then name
+//*******************************************************************************************************
+
+static int SYM_Compare(const void *a,const void *b)
+{
+    const SYMBOL *s1 = (const SYMBOL *)a,*s2 = (const SYMBOL *)b;
+    if (s1->address != s2->address) return s1->address - s2->address;
+    return strcmp(s1->name,s2->name);
+}
+
+//*******************************************************************************************************
+//      Read one symbol table line, which is <name> <hex value>[ <flags>] repeated. Flags follow the
+//                      value after one space, the next name comes after at least two.
+//*******************************************************************************************************
+
+static void SYM_ParseLine(char *line,SYMBOLTABLE *t,int *size)
+{
+    char *name,*end;
+    int value;
+    BOOL isLabel;
+    while (*line != '\0')
+    {
+        while (isspace(*line)) line++;
+        if (*line == '\0') return;
+        name = line;                                                                // Name
+        while (*line != '\0' && !isspace(*line)) line++;
+        if (*line == '\0') return;
+        *line++ = '\0';
+        value = strtol(line,&end,16);                                               // Value
+        if (end == line) return;                                                    // Not a symbol table line
+        line = end;
+        isLabel = TRUE;
+        if (line[0] == ' ' && isalpha(line[1]))                                     // Flags U M S E
+        {
+            for (line++;isalpha(*line);line++)
+                if (*line != 'M') isLabel = FALSE;
+        }
+        if (isLabel)
+        {
+            if (t->count == *size)
+            {
+                *size = (*size == 0) ? 256 : *size * 2;
+                t->symbols = (SYMBOL *)realloc(t->symbols,sizeof(SYMBOL) * (*size));
+            }
+            t->symbols[t->count].address = value & 0xFFFF;
+            t->symbols[t->count].name = strdup(name);
+            t->count++;
+        }
+    }
+}
+
+//*******************************************************************************************************
+//                              Read the labels from a listing into a table
+//*******************************************************************************************************
+
+static void SYM_ReadListing(char *fileName,SYMBOLTABLE *t)
+{
+    char line[512];
+    int size = 0;
+    BOOL inTable = FALSE;
+    FILE *f = fopen(fileName,"r");
+    if (f == NULL) return;                                                          // No listing, no labels
+    while (fgets(line,sizeof(line),f) != NULL)
+    {
+        if (inTable) SYM_ParseLine(line,t,&size);
+        if (strstr(line,"Total Error(s)") != NULL) inTable = TRUE;                  // Symbol table follows this
+    }
+    fclose(f);
+    qsort(t->symbols,t->count,sizeof(SYMBOL),SYM_Compare);
+}
+
+//*******************************************************************************************************
+//                  Find the table for the loaded ROM, reading the listing if it is new
+//*******************************************************************************************************
+
+static void SYM_Prepare(void)
+{
+    int i;
+    unsigned int hash = SYM_RomHash();
+    loadPending = FALSE;
+    for (i = 0;i < SYM_CACHE;i++)                                                   // Already read ?
+        if (cache[i].symbols != NULL && cache[i].hash == hash) { current = &cache[i];return; }
+    current = &cache[nextSlot];                                                     // Replace oldest
+    nextSlot = (nextSlot + 1) % SYM_CACHE;
+    for (i = 0;i < current->count;i++) free(current->symbols[i].name);
+    free(current->symbols);
+    current->symbols = NULL;current->count = 0;current->hash = hash;
+    SYM_ReadListing(pendingFile,current);
+}
+
+//*******************************************************************************************************
+//      Describe an address as label+offset in at most width characters, shortening the label if
+//      needed. Returns FALSE if there is no label within maxOffset bytes below the address.
+//*******************************************************************************************************
+
+BOOL SYM_Describe(WORD16 address,int maxOffset,char *buffer,int width)
+{
+    int low = 0,high,mid,offset,length;
+    char offsetText[8];
+    if (loadPending) SYM_Prepare();
+    if (current == NULL || current->count == 0) return FALSE;
+    high = current->count;
+    while (low < high)                                                              // First label above address
+    {
+        mid = (low + high) / 2;
+        if (current->symbols[mid].address <= address) low = mid + 1; else high = mid;
+    }
+    if (low == 0) return FALSE;                                                     // Nothing at or below it
+    offset = address - current->symbols[low-1].address;
+    if (offset > maxOffset) return FALSE;
+    while (low > 1 && current->symbols[low-2].address == current->symbols[low-1].address) low--;
+    offsetText[0] = '\0';
+    if (offset != 0) sprintf(offsetText,"+%x",offset);
+    length = width - strlen(offsetText);
+    if (length < 1) return FALSE;
+    sprintf(buffer,"%.*s%s",length,current->symbols[low-1].name,offsetText);
+    return TRUE;
+}
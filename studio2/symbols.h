@@ -0,0 +1,22 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Symbols.H
+//      Purpose:    Symbol table (from asmx listings) header
+//      Author:     Paul Robson
+//      Date:       20th March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include "general.h"
+
+#define SYM_MAXOFFSET   (0x100)                                                     // Furthest from a label still named
+
+void SYM_Load(char *binaryFile);
+BOOL SYM_Describe(WORD16 address,int maxOffset,char *buffer,int width);
+
+#endif // _SYMBOLS_H
@@ -17,7 +17,7 @@
 //                                      Hardware interface
 //*******************************************************************************************************
 
-static char *keys = "";
+static BYTE8 keypad = 1;                                                            // Selected keypad (1 or 2)
 
 static int nextTime = 0;                                                            // Time of next frame end
 
@@ -27,7 +27,7 @@ BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
     switch(cmd)
     {
         case HWC_READKEYBOARD:                                                      // Command 0 : read keyboard status - 0-15 or 0xFF
-            retVal = IF_KeyPressed(keys[param & 0x0F]);
+            retVal = (IF_ReadKeypad(keypad) >> (param & 0x0F)) & 1;
             break;
         case HWC_UPDATEQ:                                                           // Command 1 : update Q
             IF_SetSound(param != 0);
@@ -37,10 +37,18 @@ BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
             nextTime = IF_GetTime()+1000/60;
             break;
         case HWC_SETKEYPAD:                                                         // Command 6 : Set Keypad to player 1 or player 2
-            keys = "X123QWEASD______";                                              // Key settings for Studio 2 Player 1, Player 2
-            if (param == 2) keys = "M678YUIHJ______";
+            keypad = param;
             break;
     }
     return retVal;
 }
 
+//*******************************************************************************************************
+//                  Read a whole keypad (1 or 2) as a bit mask, bit n set if key n pressed
+//*******************************************************************************************************
+
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad)
+{
+    return IF_ReadKeypad(pad);                                                      // Key mapping is done by the interface
+}
+
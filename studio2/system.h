@@ -18,5 +18,6 @@
 #define HWC_SETKEYPAD           (3)
 
 BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param);
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad);
 
 #endif // _SYSTEM_H
@@ -0,0 +1,35 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       Trace.H
+//      Purpose:    Instruction trace record, shared by tracerun and tracediff
+//      Author:     Paul Robson
+//      Date:       21st March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "general.h"
+
+// One record per instruction, all bytes so the file is the same whatever compiler wrote it. The PC and
+// opcode bytes are from before the instruction, everything else is the state after it.
+
+#define TRACE_WROTE     (0x08)                                                      // flags bit : a memory write happened
+
+typedef struct _TraceRecord
+{
+    BYTE8 pc[2];                                                                    // Address of instruction (high first)
+    BYTE8 code[3];                                                                  // Opcode and two following bytes
+    BYTE8 D,X,P,T;                                                                  // 8 bit registers
+    BYTE8 flags;                                                                    // DF (0) IE (1) Q (2) TRACE_WROTE (3)
+    BYTE8 state;                                                                    // Frame state (1 or 2)
+    BYTE8 cycles[2];                                                                // Cycles till state switch
+    BYTE8 R[16][2];                                                                 // 16 bit registers (high first)
+    BYTE8 writeAddress[2];                                                          // Memory write, if TRACE_WROTE
+    BYTE8 writeData;
+} TRACERECORD;
+
+#endif // _TRACE_H
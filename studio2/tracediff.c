@@ -0,0 +1,209 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       TraceDiff.C
+//      Purpose:    Find the first divergence between two instruction traces
+//      Author:     Paul Robson
+//      Date:       21st March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "general.h"
+#include "trace.h"
+#include "mnemonics1802.h"
+
+// tracediff <trace A> <trace B>. Each is a trace file, or if there is no such file a command which writes
+// one, usually tracerun, e.g. tracediff "tracerun game.bin 600" "tracerun_new game.bin 600". Commands are
+// run side by side and read in lockstep. Traces are compared in large blocks with memcmp, only the block
+// with the difference is looked at record by record, so it runs as fast as the traces can be read.
+
+#define BLOCK       (8192)                                                          // Records compared at a time
+#define CONTEXT     (8)                                                             // Instructions shown before it
+
+#ifdef _WIN32
+#define popen       _popen
+#define pclose      _pclose
+#define READ_MODE   "rb"
+#else
+#define READ_MODE   "r"
+#endif
+
+typedef struct _TraceSource
+{
+    char *name;                                                                     // File or command
+    FILE *f;
+    BOOL isCommand;                                                                 // TRUE if from popen()
+    TRACERECORD *block;                                                             // Current block
+    size_t count;                                                                   // Records in it
+} TRACESOURCE;
+
+static TRACERECORD history[CONTEXT];                                                // Records before the block (A)
+static int historyCount = 0;
+
+//*******************************************************************************************************
+//                                      Open a trace file or command
+//*******************************************************************************************************
+
+static void DIFF_Open(TRACESOURCE *t,char *name)
+{
+    struct stat info;
+    t->name = name;
+    t->isCommand = (stat(name,&info) != 0);                                         // Not a file, so run it.
+    t->f = t->isCommand ? popen(name,READ_MODE) : fopen(name,"rb");
+    if (t->f == NULL) exit(fprintf(stderr,"Cannot open %s\n",name));
+    t->block = (TRACERECORD *)malloc(sizeof(TRACERECORD) * BLOCK);
+}
+
+static void DIFF_Close(TRACESOURCE *t)
+{
+    if (t->isCommand) pclose(t->f); else fclose(t->f);
+    free(t->block);
+}
+
+//*******************************************************************************************************
+//                                  Disassemble the instruction in a record
+//*******************************************************************************************************
+
+static char *DIFF_Disassemble(TRACERECORD *r,char *buffer)
+{
+    int n;
+    strcpy(buffer,_mnemonics[r->code[0]]);
+    n = strlen(buffer);
+    if (n > 2 && buffer[n-2] == '.')                                                // .1 or .2 operand
+    {
+        if (buffer[n-1] == '1') sprintf(buffer+n-2,"%02x",r->code[1]);
+        else sprintf(buffer+n-2,"%02x%02x",r->code[1],r->code[2]);
+    }
+    return buffer;
+}
+
+//*******************************************************************************************************
+//                              Print one record as a line of context
+//*******************************************************************************************************
+
+static void DIFF_PrintRecord(char *prefix,long index,TRACERECORD *r)
+{
+    char buffer[32];
+    printf("%s%10ld  %02x%02x  %-10s D=%02x DF=%d X=%x P=%x",prefix,index,r->pc[0],r->pc[1],
+                    DIFF_Disassemble(r,buffer),r->D,r->flags & 1,r->X,r->P);
+    if (r->flags & TRACE_WROTE)
+        printf("  [%02x%02x]=%02x",r->writeAddress[0],r->writeAddress[1],r->writeData);
+    printf("\n");
+}
+
+//*******************************************************************************************************
+//                  List every field that differs between the two records
+//*******************************************************************************************************
+
+static void DIFF_Field(char *name,int a,int b,int width)
+{
+    char textA[8],textB[8];
+    if (a == b) return;
+    sprintf(textA,"%0*x",width,a);sprintf(textB,"%0*x",width,b);
+    printf("    %-8s %-6s %-6s\n",name,textA,textB);
+}
+
+static void DIFF_Explain(TRACERECORD *a,TRACERECORD *b)
+{
+    char name[8];
+    int i;
+    printf("    %-8s %-6s %-6s\n","","A","B");
+    DIFF_Field("PC",(a->pc[0] << 8) | a->pc[1],(b->pc[0] << 8) | b->pc[1],4);
+    DIFF_Field("Opcode",a->code[0],b->code[0],2);
+    DIFF_Field("D",a->D,b->D,2);
+    DIFF_Field("DF",a->flags & 1,b->flags & 1,1);
+    DIFF_Field("IE",(a->flags >> 1) & 1,(b->flags >> 1) & 1,1);
+    DIFF_Field("Q",(a->flags >> 2) & 1,(b->flags >> 2) & 1,1);
+    DIFF_Field("X",a->X,b->X,1);
+    DIFF_Field("P",a->P,b->P,1);
+    DIFF_Field("T",a->T,b->T,2);
+    DIFF_Field("State",a->state,b->state,1);
+    DIFF_Field("Cycles",(a->cycles[0] << 8) | a->cycles[1],(b->cycles[0] << 8) | b->cycles[1],4);
+    for (i = 0;i < 16;i++)
+    {
+        sprintf(name,"R%x",i);
+        DIFF_Field(name,(a->R[i][0] << 8) | a->R[i][1],(b->R[i][0] << 8) | b->R[i][1],4);
+    }
+    DIFF_Field("Wrote",(a->flags >> 3) & 1,(b->flags >> 3) & 1,1);
+    if ((a->flags & b->flags & TRACE_WROTE) != 0)
+    {
+        DIFF_Field("Address",(a->writeAddress[0] << 8) | a->writeAddress[1],(b->writeAddress[0] << 8) | b->writeAddress[1],4);
+        DIFF_Field("Data",a->writeData,b->writeData,2);
+    }
+}
+
+//*******************************************************************************************************
+//                      Report the first difference, at position n in the current block
+//*******************************************************************************************************
+
+static void DIFF_Report(TRACESOURCE *a,TRACESOURCE *b,long base,size_t n)
+{
+    long i;
+    printf("First difference at instruction %ld\n\n",base+n);
+    for (i = -CONTEXT;i < 0;i++)                                                    // Context, the same in both
+    {
+        if ((long)n + i >= 0) DIFF_PrintRecord("   ",base+n+i,&a->block[n+i]);
+        else if (historyCount + (long)n + i >= 0) DIFF_PrintRecord("   ",base+n+i,&history[historyCount+n+i]);
+    }
+    DIFF_PrintRecord("A: ",base+n,&a->block[n]);
+    DIFF_PrintRecord("B: ",base+n,&b->block[n]);
+    printf("\n");
+    DIFF_Explain(&a->block[n],&b->block[n]);
+}
+
+//*******************************************************************************************************
+//                                              Main Program
+//*******************************************************************************************************
+
+int main(int argc,char *argv[])
+{
+    TRACESOURCE a,b;
+    long base = 0;
+    size_t i,n,keep;
+    int result = 0;
+    if (argc != 3) exit(fprintf(stderr,"tracediff <trace file or command> <trace file or command>\n"));
+    DIFF_Open(&a,argv[1]);
+    DIFF_Open(&b,argv[2]);
+    while (1)
+    {
+        a.count = fread(a.block,sizeof(TRACERECORD),BLOCK,a.f);
+        b.count = fread(b.block,sizeof(TRACERECORD),BLOCK,b.f);
+        n = (a.count < b.count) ? a.count : b.count;
+        if (memcmp(a.block,b.block,n * sizeof(TRACERECORD)) != 0)                   // Different, find where
+        {
+            for (i = 0;memcmp(&a.block[i],&b.block[i],sizeof(TRACERECORD)) == 0;i++) {}
+            DIFF_Report(&a,&b,base,i);
+            result = 1;
+            break;
+        }
+        if (a.count != b.count)                                                     // One stopped early
+        {
+            printf("Traces agree for %ld instructions, then %s ends\n",base+n,(a.count < b.count) ? a.name : b.name);
+            result = 1;
+            break;
+        }
+        if (n == 0)
+        {
+            printf("Traces are identical, %ld instructions\n",base);
+            break;
+        }
+        keep = (n < CONTEXT) ? n : CONTEXT;                                         // Keep the tail for context
+        if (historyCount + keep > CONTEXT)
+        {
+            int drop = historyCount + keep - CONTEXT;
+            memmove(history,history+drop,(historyCount - drop) * sizeof(TRACERECORD));
+            historyCount -= drop;
+        }
+        memcpy(history+historyCount,a.block+n-keep,keep * sizeof(TRACERECORD));
+        historyCount += keep;
+        base += n;
+    }
+    DIFF_Close(&a);
+    DIFF_Close(&b);
+    return result;
+}
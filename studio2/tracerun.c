@@ -0,0 +1,107 @@
+//*******************************************************************************************************
+//*******************************************************************************************************
+//
+//      Name:       TraceRun.C
+//      Purpose:    Run a ROM headless, writing an instruction trace to standard output
+//      Author:     Paul Robson
+//      Date:       21st March 2013
+//
+//*******************************************************************************************************
+//*******************************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "general.h"
+#include "cpu.h"
+#include "system.h"
+#include "trace.h"
+
+// tracerun <binary> <frames> [<input>]. Build one of these for each core (or core configuration) being
+// compared, and give both the same input. The input file has lines <frame> <keypad> <hex key mask>, the
+// mask holds from that frame on ; without one no keys are pressed. Memory writes come from the core
+// itself (built with TRACE_WRITES) so whichever decoder does the work is traced.
+
+#define MAX_INPUT   (1024)                                                          // Input changes
+
+static int frame = 0;                                                               // Frames completed
+static int inputCount = 0;
+static int inputFrame[MAX_INPUT],inputPad[MAX_INPUT];
+static WORD16 inputMask[MAX_INPUT];
+
+//*******************************************************************************************************
+//                      System interface : count frames, keypads from the input file
+//*******************************************************************************************************
+
+BYTE8 SYSTEM_Command(BYTE8 cmd,BYTE8 param)
+{
+    if (cmd == HWC_FRAMESYNC) frame++;                                              // No waiting, as fast as possible
+    return 0;
+}
+
+WORD16 SYSTEM_ReadKeypad(BYTE8 pad)
+{
+    WORD16 mask = 0;
+    int i;
+    for (i = 0;i < inputCount;i++)                                                  // Latest change for this pad
+        if (inputPad[i] == pad && inputFrame[i] <= frame) mask = inputMask[i];
+    return mask;
+}
+
+static void TRACE_LoadInput(char *fileName)
+{
+    char line[128];
+    unsigned int mask;
+    FILE *f = fopen(fileName,"r");
+    if (f == NULL) exit(fprintf(stderr,"Cannot open input file %s\n",fileName));
+    while (fgets(line,sizeof(line),f) != NULL && inputCount < MAX_INPUT)
+        if (sscanf(line,"%d %d %x",&inputFrame[inputCount],&inputPad[inputCount],&mask) == 3)
+            inputMask[inputCount++] = mask;
+    fclose(f);
+}
+
+//*******************************************************************************************************
+//                                              Main Program
+//*******************************************************************************************************
+
+int main(int argc,char *argv[])
+{
+    TRACERECORD r;
+    CPU1802STATE s;
+    WORD16 pc,address;
+    BYTE8 data;
+    int i,frames;
+    if (argc < 3) exit(fprintf(stderr,"tracerun <binary> <frames> [<input>]\n"));
+    frames = atoi(argv[2]);
+    if (argc >= 4) TRACE_LoadInput(argv[3]);
+    #ifdef _WIN32
+    _setmode(_fileno(stdout),_O_BINARY);                                            // Trace is binary
+    #endif
+    CPU_Reset();
+    CPU_LoadBinaryImage(argv[1]);
+    CPU_GetTraceWrite(&address,&data);                                              // Forget any write so far
+    while (frame < frames)
+    {
+        pc = CPU_ReadProgramCounter();
+        r.pc[0] = pc >> 8;r.pc[1] = pc & 0xFF;
+        for (i = 0;i < 3;i++) r.code[i] = CPU_ReadMemory((pc+i) & 0xFFFF);
+        CPU_Execute();
+        CPU_ReadState(&s);
+        r.D = s.D;r.X = s.X;r.P = s.P;r.T = s.T;r.state = s.State;
+        r.cycles[0] = (s.Cycles >> 8) & 0xFF;r.cycles[1] = s.Cycles & 0xFF;
+        for (i = 0;i < 16;i++) { r.R[i][0] = s.R[i] >> 8;r.R[i][1] = s.R[i] & 0xFF; }
+        r.flags = (s.DF & 1) | ((s.IE & 1) << 1) | ((s.Q & 1) << 2);
+        r.writeAddress[0] = r.writeAddress[1] = r.writeData = 0;
+        if (CPU_GetTraceWrite(&address,&data))
+        {
+            r.flags |= TRACE_WROTE;
+            r.writeAddress[0] = address >> 8;r.writeAddress[1] = address & 0xFF;r.writeData = data;
+        }
+        if (fwrite(&r,sizeof(r),1,stdout) != 1) break;                              // Reader has gone
+    }
+    return 0;
+}